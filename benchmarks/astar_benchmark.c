@@ -0,0 +1,428 @@
+// Benchmark harness for the A* search module
+//
+// Generates reproducible workloads from a seed and runs a fixed set of
+// queries against them, recording the eval cost, utime() microseconds,
+// cycles and paths expanded for each query, so that changes to the module
+// can be compared against a recorded baseline.  The workloads are:
+//
+//     "grid"     An open 2D grid with scattered obstacles, unit costs.
+//     "maze"     A 2D maze with a few extra openings so it has loops.
+//     "terrain"  A 2D grid with edge costs from 1 to 9 by terrain.
+//     "lattice"  A 3D room lattice with scattered obstacles.
+//     "hybrid"   A 2D grid with off-grid rooms linking parts of it, which
+//                the distance rule can't find a distance for.
+//
+// Usage: clone or load this object and call
+//
+//     run_benchmark("grid", 1000, 50, 1, 0, "/log/astar_benchmark");
+//
+// for a 1000x1000 grid, 50 queries, seed 1, no control flags, logging to
+// the file given.  Each query set is run three times: with caching off,
+// then with caching on twice, for cold and warm cache figures.  Queries
+// run one per call_out(), continuing via the scheduling rule as needed,
+// so even the large workloads run without stalling.  When the runs are
+// done, the results go to the callback, if one is given, or a summary to
+// the player who started them.  compare_benchmark() reports the
+// difference between two log files.  The maze is generated in a single
+// execution, so the largest maze that can be used depends on the driver's
+// eval limit; the other workloads are worked out as they are searched and
+// have no such limit.
+
+#include <astar.h>
+
+inherit "/mod/algorithm/astar";
+
+// Fields of a benchmark result
+#define Result_Phase        0
+#define Result_Query        1
+#define Result_Eval         2
+#define Result_Time         3
+#define Result_Cycles       4
+#define Result_Expanded     5
+#define Result_Result       6
+#define Result_Length       7
+#define Result_Fields       8
+
+// Maze cell openings
+#define Maze_East           1
+#define Maze_South          2
+
+// Phases of a benchmark run
+#define Phases              ({ "uncached", "cold", "warm" })
+
+// The workload being run
+private string workload;
+private int width;
+private int height;
+private int depth;
+private int seed;
+private int obstacle_percent;
+private int * maze;
+private mapping links;
+
+// The benchmark run in progress
+private mixed * queries;
+private int control_flags;
+private int phase;
+private int query_index;
+private mixed * results;
+private string log_file;
+private closure callback;
+private object owner;
+
+// Measurements for the query in progress
+private int cycle_eval;
+private int * cycle_time;
+private int query_eval;
+private int query_time;
+
+// The random number generator, a linear congruential generator so that
+// workloads come out the same on every driver.
+private int rng_state;
+
+// SECTION: Workload generation
+
+private int benchmark_random(int range) {
+	rng_state = (rng_state * 1103515245 + 12345) & 0x7FFFFFFF;
+	return (rng_state >> 8) % range;
+}
+
+// Hash of a node and the seed, for properties of nodes that are worked
+// out when needed rather than stored, so large grids take no memory.
+
+private int benchmark_hash(int node) {
+	int hash = (node * 0x9E3779B1 + seed * 0x85EBCA6B) & 0x7FFFFFFF;
+	hash = ((hash ^ (hash >> 15)) * 0x2C1B3C6D) & 0x7FFFFFFF;
+	return hash ^ (hash >> 13);
+}
+
+private int benchmark_blocked(int node) {
+	return obstacle_percent && benchmark_hash(node) % 100 < obstacle_percent;
+}
+
+private int benchmark_terrain(int node) {
+	return 1 + (benchmark_hash(node) >> 7) % 9;
+}
+
+// Builds a maze by randomized depth-first search over the grid's cells,
+// then knocks out a few more walls so there is more than one way through.
+
+private void benchmark_build_maze() {
+	int cells = width * height;
+	maze = allocate(cells);
+	int * seen = allocate(cells);
+	int * stack = allocate(cells);
+	int top = 1;
+	seen[0] = 1;
+	while(top) {
+		int cell = stack[top - 1];
+		int x = cell % width;
+		int y = cell / width;
+		int * options = ({});
+		if(x > 0 && !seen[cell - 1])
+			options += ({ cell - 1 });
+		if(x < width - 1 && !seen[cell + 1])
+			options += ({ cell + 1 });
+		if(y > 0 && !seen[cell - width])
+			options += ({ cell - width });
+		if(y < height - 1 && !seen[cell + width])
+			options += ({ cell + width });
+		if(!sizeof(options)) {
+			top--;
+			continue;
+		}
+		int next = options[benchmark_random(sizeof(options))];
+		if(next == cell + 1)
+			maze[cell] |= Maze_East;
+		else if(next == cell - 1)
+			maze[next] |= Maze_East;
+		else if(next == cell + width)
+			maze[cell] |= Maze_South;
+		else
+			maze[next] |= Maze_South;
+		seen[next] = 1;
+		stack[top++] = next;
+	}
+	for(int ix = cells / 20; ix > 0; ix--)
+		maze[benchmark_random(cells)] |= benchmark_random(2) ? Maze_East : Maze_South;
+}
+
+// Adds off-grid rooms to a grid, each linked both ways to a few grid
+// nodes and to the room before it.
+
+private void benchmark_build_links() {
+	links = ([]);
+	int rooms = (width * height) / 400 + 1;
+	for(int ix = 0; ix < rooms; ix++) {
+		string room = "room" + ix;
+		links[room] = ({});
+		int count = 2 + benchmark_random(3);
+		for(int iy = 0; iy < count; iy++) {
+			int node = benchmark_random(width * height);
+			int cost = 1 + benchmark_random(5);
+			links[room] += ({ ({ node, "exit " + node, cost }) });
+			links[node] = (links[node] || ({})) + ({ ({ room, "enter " + room, cost }) });
+		}
+		if(ix) {
+			string prior = "room" + (ix - 1);
+			links[room] += ({ ({ prior, "enter " + prior, 2 }) });
+			links[prior] += ({ ({ room, "enter " + room, 2 }) });
+		}
+	}
+}
+
+private mixed benchmark_random_node() {
+	int nodes = width * height * depth;
+	for(;;) {
+		int node = benchmark_random(nodes);
+		if(!benchmark_blocked(node))
+			return node;
+	}
+}
+
+private void benchmark_build(string name, int size, int query_count) {
+	workload = name;
+	seed = rng_state;
+	width = size;
+	height = size;
+	depth = 1;
+	obstacle_percent = 0;
+	maze = 0;
+	links = 0;
+	switch(name) {
+	case "grid"     :
+		obstacle_percent = 20;
+		break;
+	case "maze"     :
+		benchmark_build_maze();
+		break;
+	case "terrain"  :
+		break;
+	case "lattice"  :
+		depth = size;
+		obstacle_percent = 25;
+		break;
+	case "hybrid"   :
+		obstacle_percent = 10;
+		benchmark_build_links();
+		break;
+	default         :
+		raise_error("Unknown benchmark workload: " + name);
+	}
+	// Every fourth query repeats one from earlier in the set, as real
+	// traffic repeats itself, so caching has something to show for itself.
+	queries = allocate(query_count);
+	for(int ix = 0; ix < query_count; ix++)
+		if(ix % 4 == 3)
+			queries[ix] = queries[benchmark_random(ix)];
+		else
+			queries[ix] = ({ benchmark_random_node(), benchmark_random_node() });
+}
+
+// SECTION: A* rules
+
+mixed * benchmark_neighbors_rule(mixed * pathfind) {
+	mixed node = pathfind[Astar_Pathfind_Active_Node];
+	if(stringp(node))
+		return links[node];
+	int x = node % width;
+	int y = (node / width) % height;
+	int z = node / (width * height);
+	int layer = width * height;
+	mixed * out = ({});
+	if(maze) {
+		if(x < width - 1 && (maze[node] & Maze_East))
+			out += ({ ({ node + 1, "east", 1 }) });
+		if(x > 0 && (maze[node - 1] & Maze_East))
+			out += ({ ({ node - 1, "west", 1 }) });
+		if(y < height - 1 && (maze[node] & Maze_South))
+			out += ({ ({ node + width, "south", 1 }) });
+		if(y > 0 && (maze[node - width] & Maze_South))
+			out += ({ ({ node - width, "north", 1 }) });
+		return out;
+	}
+	mixed * moves = ({});
+	if(x < width - 1)
+		moves += ({ ({ node + 1, "east" }) });
+	if(x > 0)
+		moves += ({ ({ node - 1, "west" }) });
+	if(y < height - 1)
+		moves += ({ ({ node + width, "south" }) });
+	if(y > 0)
+		moves += ({ ({ node - width, "north" }) });
+	if(z < depth - 1)
+		moves += ({ ({ node + layer, "down" }) });
+	if(z > 0)
+		moves += ({ ({ node - layer, "up" }) });
+	foreach(mixed * move : moves)
+		if(!benchmark_blocked(move[0]))
+			out += ({ ({ move[0], move[1], workload == "terrain" ? benchmark_terrain(move[0]) : 1 }) });
+	if(links && links[node])
+		out += links[node];
+	return out;
+}
+
+mixed benchmark_distance_rule(mixed * pathfind) {
+	mixed a = pathfind[Astar_Pathfind_Active_Node];
+	mixed b = pathfind[Astar_Pathfind_To];
+	if(stringp(a) || stringp(b))
+		return -1;
+	int dx = a % width - b % width;
+	int dy = (a / width) % height - (b / width) % height;
+	int dz = a / (width * height) - b / (width * height);
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+void benchmark_cycle_process(mixed * pathfind) {
+	cycle_eval = get_eval_cost();
+	cycle_time = utime();
+}
+
+private void benchmark_cycle_end() {
+	int * now = utime();
+	query_eval += cycle_eval - get_eval_cost();
+	query_time += (now[0] - cycle_time[0]) * 1000000 + now[1] - cycle_time[1];
+}
+
+int benchmark_run_limit_rule(mixed * pathfind) {
+	if(get_eval_cost() > __MAX_EVAL_COST__ / 2)
+		return 0;
+	benchmark_cycle_end();
+	return 1;
+}
+
+void benchmark_scheduling_rule(closure func, int delay, mixed * pathfind) {
+	call_out(func, 0, pathfind);
+}
+
+// SECTION: Benchmark running
+
+void benchmark_next_query();
+
+private void benchmark_finish() {
+	int * eval = allocate(sizeof(Phases));
+	int * usec = allocate(sizeof(Phases));
+	int * expanded = allocate(sizeof(Phases));
+	foreach(mixed * result : results) {
+		eval[result[Result_Phase]] += result[Result_Eval];
+		usec[result[Result_Phase]] += result[Result_Time];
+		expanded[result[Result_Phase]] += result[Result_Expanded];
+	}
+	if(callback) {
+		funcall(callback, results);
+	} else if(owner) {
+		string out = "A* benchmark " + workload + " " + width + " seed " + seed + ":\n";
+		for(int ix = 0; ix < sizeof(Phases); ix++)
+			out += sprintf("    %-10s eval %12d  usec %12d  expanded %10d\n", Phases[ix], eval[ix], usec[ix], expanded[ix]);
+		tell_object(owner, out);
+	}
+}
+
+void benchmark_query_done(mixed * pathfind) {
+	benchmark_cycle_end();
+	mixed result = pathfind[Astar_Pathfind_Result];
+	mixed * entry = allocate(Result_Fields);
+	entry[Result_Phase] = phase;
+	entry[Result_Query] = query_index;
+	entry[Result_Eval] = query_eval;
+	entry[Result_Time] = query_time;
+	entry[Result_Cycles] = pathfind[Astar_Pathfind_Cycle_Index];
+	entry[Result_Expanded] = pathfind[Astar_Pathfind_Stats_Expanded];
+	entry[Result_Result] = pointerp(result) ? 0 : result;
+	entry[Result_Length] = pointerp(result) ? sizeof(result[Astar_Path_Nodes]) : 0;
+	results += ({ entry });
+	if(log_file)
+		write_file(log_file, sprintf("%s %d %d %s %d %d %d %d %d %d %d\n", workload, width, seed, Phases[phase],
+			query_index, query_eval, query_time, entry[Result_Cycles], entry[Result_Expanded], entry[Result_Result],
+			entry[Result_Length]));
+	query_index++;
+	call_out(#'benchmark_next_query, 0);
+}
+
+void benchmark_next_query() {
+	if(query_index >= sizeof(queries)) {
+		query_index = 0;
+		phase++;
+		if(phase >= sizeof(Phases))
+			return benchmark_finish();
+		// The cold run starts with an empty cache, and the warm run keeps it.
+		if(Phases[phase] == "cold")
+			set_astar_caching(1);
+	}
+	mixed * query = queries[query_index];
+	query_eval = 0;
+	query_time = 0;
+	cycle_eval = get_eval_cost();
+	cycle_time = utime();
+	astar_find_path(query[0], query[1], 0, #'benchmark_query_done, control_flags);
+}
+
+// run_benchmark()
+//
+// Runs a benchmark: generates the workload named by 'name' at the size
+// given (the length of each side of the grid, maze or lattice) from
+// 'random_seed', then runs a set of 'query_count' queries with the control
+// flags given.  Results are appended to 'file', if given, one line per
+// query, and passed to 'done', if given, as an array of results; see the
+// Result_* macros above.
+
+varargs void run_benchmark(string name, int size, int query_count, int random_seed, int flags, string file, closure done) {
+	rng_state = random_seed;
+	benchmark_build(name, size, query_count);
+	control_flags = flags;
+	log_file = file;
+	callback = done;
+	owner = this_player();
+	results = ({});
+	phase = 0;
+	query_index = 0;
+	set_astar_caching(0);
+	call_out(#'benchmark_next_query, 0);
+}
+
+// compare_benchmark()
+//
+// Compares two benchmark log files, 'baseline' and 'current', reporting
+// the totals for each workload and phase found in both and the change from
+// one to the other.
+
+string compare_benchmark(string baseline, string current) {
+	mapping * totals = ({ ([]), ([]) });
+	string * files = ({ baseline, current });
+	for(int ix = 0; ix < 2; ix++) {
+		string text = read_file(files[ix]);
+		if(!text)
+			raise_error("Cannot read benchmark log " + files[ix]);
+		foreach(string line : explode(text, "\n")) {
+			string name;
+			string phase_name;
+			int size, run_seed, query, eval, usec, cycles, expanded;
+			if(sscanf(line, "%s %d %d %s %d %d %d %d %d", name, size, run_seed, phase_name, query, eval, usec, cycles, expanded) != 9)
+				continue;
+			string key = name + " " + size + " " + run_seed + " " + phase_name;
+			int * total = totals[ix][key] ||= allocate(3);
+			total[0] += eval;
+			total[1] += usec;
+			total[2] += expanded;
+		}
+	}
+	string out = "";
+	foreach(string key : sort_array(m_indices(totals[0]), #'>))
+		if(member(totals[1], key)) {
+			int * before = totals[0][key];
+			int * after = totals[1][key];
+			out += sprintf("%-30s eval %+6.1f%%  usec %+6.1f%%  expanded %+6.1f%%\n", key,
+				before[0] ? (after[0] - before[0]) * 100.0 / before[0] : 0.0,
+				before[1] ? (after[1] - before[1]) * 100.0 / before[1] : 0.0,
+				before[2] ? (after[2] - before[2]) * 100.0 / before[2] : 0.0);
+		}
+	return out;
+}
+
+void create() {
+	set_astar_neighbors_rule(#'benchmark_neighbors_rule);
+	set_astar_distance_rule(#'benchmark_distance_rule);
+	set_astar_run_limit_rule(#'benchmark_run_limit_rule);
+	set_astar_cycle_process(#'benchmark_cycle_process);
+	set_astar_scheduling_rule(#'benchmark_scheduling_rule);
+}
@@ -67,6 +67,14 @@ int astar_node_key_rule(int * node) {
 	return (node[X] << 16) | node[Y];
 }
 
+// Apply edge rule gives the node reached by following an edge from a
+// node.  Our edges are offsets, so this just adds them up; it lets the
+// cache store paths compactly, as their edges alone.
+
+int * astar_apply_edge_rule(int * node, int * edge) {
+	return ({ node[X] + edge[X], node[Y] + edge[Y] });
+}
+
 // Run limit rule tells the algorithm when to stop running and continue
 // on a call_out.
 
@@ -81,7 +89,9 @@ void create() {
 	set_astar_distance_rule(#'astar_distance_rule);
 	set_astar_node_key_rule(#'astar_node_key_rule);
 	set_astar_run_limit_rule(#'astar_run_limit_rule);
+	set_astar_apply_edge_rule(#'astar_apply_edge_rule);
 	set_astar_caching(1);
+	set_astar_compact_caching(1);
 }
 
 // This is our callback when pathfinding completes (for better or worse);
@@ -50,6 +50,15 @@
 // is presently used to perform pathfinding in 2D and 3D coordinate-space
 // and hybrid coordinate-space/arbitrary-linkage MUD areas, as well as
 // searching in the problem space made up of A* results from those instances.
+// The companion module astar_hierarchy.c, which inherits this one, does the
+// latter for you.
+// Another companion, the daemon astar_metrics.c, collects totals from the
+// pathfinds of every object using this module, and astar_scheduler.c shares
+// out time among their continuations under central scheduling.
+// A third, astar_replan.c, keeps searches around to repair their paths as
+// the start moves and the graph changes, astar_flood.c builds distance
+// fields leading to a node from everywhere within reach, and astar_grid.c
+// searches uniform-cost grids with jump point search.
 
 // In order to work properly with A* search as implemented by this module,
 // your situation needs to be describable in terms of a few crucial concepts.
@@ -123,9 +132,10 @@
 //         Will be set to the edge from the previous node in the path
 //         to the active node.  Set to 0 at the beginning of a path.
 //     pathfind[Astar_Pathfind_Active_Path]
-//         Will be set to the entire path leading to the active node.
-//         This is a path data structure as defined by the Astar_Path_*
-//         macros in astar.h.
+//         Will be set to the entire path leading to the active node, if
+//         the instance has declared Astar_Rule_Dependency_Active_Path
+//         (see the notes on rule dependencies below).  This is a path
+//         data structure as defined by the Astar_Path_* macros in astar.h.
 //
 // The return value that the neighbors rule should provide is an array of
 // three-element arrays in which the first element is a node, the second
@@ -159,6 +169,99 @@ closure query_astar_neighbors_rule() {
 	return neighbors_rule;
 }
 
+// Batch neighbors rule
+//
+// The batch neighbors rule can be used in place of the neighbors rule to
+// retrieve the neighbors of many nodes at once, which saves a good deal of
+// time if your neighbor lookups have a high overhead per call, like a
+// database query.  Each pass of the pathfinder works with all the paths at
+// the best cost it has on hand; when a batch neighbors rule is defined, it
+// is called once per pass for all of them, with the astar pathfind data
+// structure as argument (see the notes on the neighbors rule).  Fields set
+// specifically for this retrieval are:
+//
+//     pathfind[Astar_Pathfind_Active_Nodes]
+//         An array of the nodes whose neighbors we want to retrieve.
+//     pathfind[Astar_Pathfind_Active_Edges]
+//         An array of the edges from the previous node in each path to
+//         the corresponding node in Astar_Pathfind_Active_Nodes, with 0
+//         for a node at the beginning of a path.
+//
+// The return value needed is an array with one element for each node in
+// Astar_Pathfind_Active_Nodes, in the same order, each of which is a list
+// of neighbors in the form the neighbors rule returns.  As with the
+// neighbors rule, Astar_Result_Processing may be returned instead to have
+// the request retried slightly later via the scheduling rule.
+//
+// If a batch neighbors rule is defined, the neighbors rule is not used.
+
+private closure batch_neighbors_rule;
+
+void set_astar_batch_neighbors_rule(closure val) {
+	batch_neighbors_rule = val;
+}
+
+closure query_astar_batch_neighbors_rule() {
+	return batch_neighbors_rule;
+}
+
+// Reverse neighbors rule
+//
+// The reverse neighbors rule is used by bidirectional pathfinds (see
+// Astar_Pathfind_Control_Flag_Bidirectional in astar.h) to search backward
+// from the target node.  It is called as the neighbors rule is, and should
+// return the nodes from which pathfind[Astar_Pathfind_Active_Node] can be
+// reached, in the same form the neighbors rule uses, where the edge given
+// for each node is the edge used to reach the active node from it and the
+// cost is the cost of that edge.
+//
+// While the backward search is being worked with, the pathfind data
+// structure is turned around: pathfind[Astar_Pathfind_Direction] is 1,
+// pathfind[Astar_Pathfind_From] holds the target node and
+// pathfind[Astar_Pathfind_To] the starting node, so 'validate' works
+// unchanged, and the active path runs backward from the target node.
+//
+// A graph that needs a reverse neighbors rule is one where the way from a
+// node to another can differ from the way back, so the distance rule's
+// estimate of the distance from the active node to
+// pathfind[Astar_Pathfind_To] says nothing reliable about the distance
+// the backward search needs, from pathfind[Astar_Pathfind_To] to the
+// active node; an estimate too high there would have the pathfind return
+// paths that aren't the cheapest.  So an instance with both a reverse
+// neighbors rule and a distance rule needs a reverse distance rule as well
+// for bidirectional pathfinds, set with set_astar_reverse_distance_rule().
+// It is called as the distance rule is, during the backward search, and
+// should return an estimate, never too high, of the distance from
+// pathfind[Astar_Pathfind_To] to pathfind[Astar_Pathfind_Active_Node], or
+// -1 if it cannot be determined.  Bidirectional pathfinds without one raise
+// an error.
+//
+// If no reverse neighbors rule is defined, the graph is taken to be
+// symmetric and the neighbors rule (or batch neighbors rule) is used for
+// the backward search as well; the edges along the backward portion of the
+// result are then found by looking up the neighbors of each of its nodes
+// once the path is known.
+
+private closure reverse_neighbors_rule;
+
+void set_astar_reverse_neighbors_rule(closure val) {
+	reverse_neighbors_rule = val;
+}
+
+closure query_astar_reverse_neighbors_rule() {
+	return reverse_neighbors_rule;
+}
+
+private closure reverse_distance_rule;
+
+void set_astar_reverse_distance_rule(closure val) {
+	reverse_distance_rule = val;
+}
+
+closure query_astar_reverse_distance_rule() {
+	return reverse_distance_rule;
+}
+
 // Distance rule
 //
 // The distance rule is used to determine the distance (for non-locational
@@ -177,7 +280,9 @@ closure query_astar_neighbors_rule() {
 // The return value needed is a int or float value indicating the distance
 // (or estimating the cost), or -1 if the distance cannot be determined.
 //
-// Using a distance rule is optional but strongly encouraged.
+// Using a distance rule is optional but strongly encouraged.  For graphs
+// whose nodes have no coordinates to measure between, astar_flood.c offers
+// a distance rule based on precomputed costs to landmark nodes.
 
 private closure distance_rule;
 
@@ -189,6 +294,94 @@ closure query_astar_distance_rule() {
 	return distance_rule;
 }
 
+// Targets distance rule
+//
+// For pathfinds with several targets (see astar_find_path_any()), the
+// distance needed is the distance to the nearest of them.  By default, the
+// module calls the distance rule once for each target, with
+// pathfind[Astar_Pathfind_To] set to it, and uses the smallest result, which
+// costs a rule call per target per node reached.  An instance that can do
+// better, e.g. with a spatial index of its targets, can provide a targets
+// distance rule, called as the distance rule is, which should consult
+//
+//     pathfind[Astar_Pathfind_Targets]
+//         A mapping of the node keys of the targets to the target nodes.
+//
+// and return the distance from the active node to the nearest target, or -1
+// if it cannot be determined.
+
+private closure targets_distance_rule;
+
+void set_astar_targets_distance_rule(closure val) {
+	targets_distance_rule = val;
+}
+
+closure query_astar_targets_distance_rule() {
+	return targets_distance_rule;
+}
+
+// Heuristic weight
+//
+// Multiplying the distance rule's estimates by a weight greater than 1.0
+// makes the pathfinder favor paths that get closer to the target over
+// paths that are cheap so far, which usually finds a path with much less
+// searching, at the price of the path perhaps not being the cheapest.  If
+// the distance rule never overestimates and the pathfind uses
+// Astar_Pathfind_Control_Flag_Decrease_Key, the path found costs at most
+// the weight times as much as the cheapest.  Weights below 1.0 are
+// rejected.  With
+//
+//     set_astar_heuristic_weight(1.5);
+//
+// the weight applies to all of the instance's pathfinds; astar_find_path()
+// can also be given a weight for a single pathfind, and see
+// astar_find_path_anytime() for pathfinds that start with a high weight and
+// lower it as they go.  The weight also applies to the distances held in
+// pathfind and path data structures.  The default weight is 1.0.  Paths
+// found with any other weight are not cached, and those pathfinds are not
+// joined with others by request coalescing, since their paths may not be
+// the cheapest; cached paths are still used by weighted pathfinds.
+
+private float heuristic_weight = 1.0;
+
+void set_astar_heuristic_weight(float val) {
+	if(val < 1.0)
+		raise_error("Heuristic weight must be at least 1.0");
+	heuristic_weight = val;
+}
+
+float query_astar_heuristic_weight() {
+	return heuristic_weight;
+}
+
+// Tie-breaking
+//
+// Where many paths have the same cost, as on open grids, where a great many
+// routes to a node cost the same, the pathfinder would by default work with
+// all of them together, expanding a whole plateau of equally promising
+// paths before getting any closer to the target.  With
+//
+//     set_astar_tie_breaking(Astar_Tie_Breaking_Low_Distance);
+//
+// paths of equal cost are instead worked with one preference level at a
+// time, by the policy given, one of the Astar_Tie_Breaking_* values from
+// astar.h.  Astar_Tie_Breaking_Low_Distance, favoring the paths that have
+// come farthest, usually heads straight through a plateau to the target;
+// Astar_Tie_Breaking_First_Reached and Astar_Tie_Breaking_Last_Reached take
+// them in the order they were reached or the reverse.  Since fewer paths
+// are worked with per pass, batch neighbors rules get smaller batches.  The
+// default is Astar_Tie_Breaking_None.
+
+private int tie_breaking;
+
+void set_astar_tie_breaking(int val) {
+	tie_breaking = val;
+}
+
+int query_astar_tie_breaking() {
+	return tie_breaking;
+}
+
 // Node rule
 //
 // The node rule is used to convert the representation of a node into the
@@ -230,6 +423,54 @@ closure query_astar_node_key_rule() {
 	return node_key_rule;
 }
 
+// Bounded space
+//
+// When nodes are points in a bounded coordinate space, as ({ x, y }) or
+// ({ x, y, z }) arrays of ints, the module can work out their node keys
+// itself, without calling a node key rule, and keep track of the nodes a
+// pathfind has visited in an array indexed by node key rather than a
+// mapping.  With
+//
+//     set_astar_bounded_space(({ min_x, min_y, min_z }), ({ max_x, max_y, max_z }));
+//
+// the node key of a node is its position in the space, counting along the
+// last coordinate fastest, so keys run from 0 to one less than the number
+// of points in the space, and the node key rule is no longer used.  Each
+// pathfind then allocates an array with an element for every point in the
+// space, which must fit within the driver's maximum array size; this is
+// meant for zones of modest size that are searched often.  A node outside
+// the bounds is an error.  set_astar_bounded_space(0, 0) turns it off.
+
+private int * bounded_min;
+private int * bounded_dimensions;
+private int bounded_size;
+
+void set_astar_bounded_space(int * minimum, int * maximum) {
+	if(!minimum) {
+		bounded_min = 0;
+		bounded_dimensions = 0;
+		bounded_size = 0;
+		return;
+	}
+	if(sizeof(minimum) != sizeof(maximum))
+		raise_error("Bounded space minimum and maximum have different numbers of coordinates");
+	bounded_min = copy(minimum);
+	bounded_dimensions = allocate(sizeof(minimum));
+	bounded_size = 1;
+	for(int ix = 0; ix < sizeof(minimum); ix++) {
+		bounded_dimensions[ix] = maximum[ix] - minimum[ix] + 1;
+		bounded_size *= bounded_dimensions[ix];
+	}
+}
+
+int * query_astar_bounded_space_minimum() {
+	return bounded_min;
+}
+
+int query_astar_bounded_space_size() {
+	return bounded_size;
+}
+
 // Completion rule
 //
 // The completion rule can be used to determine whether an acceptable path
@@ -299,6 +540,45 @@ closure query_astar_run_limit_rule() {
 	return run_limit_rule;
 }
 
+// Adaptive run limit
+//
+// Calling the run limit rule on every iteration of the pathfinder costs a
+// closure call each time, and a rule that checks a fixed threshold can
+// still be taken over it by an expensive iteration.  The module can instead
+// limit each processing cycle to a budget of eval ticks, microseconds, or
+// both, with
+//
+//     set_astar_adaptive_run_limit(eval_ticks, microseconds);
+//
+// (either may be 0 for no limit of that kind).  It measures the cost of the
+// iterations done so far in the cycle, works out how many more will fit in
+// what is left of the budget, and only checks again once about half of
+// those are done (up to Astar_Adaptive_Run_Limit_Max_Interval iterations
+// later), ending the cycle when the next iteration would not fit.  It also
+// ends the cycle when fewer than Astar_Adaptive_Run_Limit_Reserve eval
+// ticks remain of the driver's limit.  For a reasonable default,
+//
+//     set_astar_adaptive_run_limit(Astar_Adaptive_Run_Limit_Default_Budget);
+//
+// An adaptive run limit and a run limit rule can be used together, though
+// the rule, if any, is still called on every iteration.
+
+private int adaptive_run_limit;
+private int adaptive_run_limit_time;
+
+varargs void set_astar_adaptive_run_limit(int eval_ticks, int microseconds) {
+	adaptive_run_limit = eval_ticks;
+	adaptive_run_limit_time = microseconds;
+}
+
+int query_astar_adaptive_run_limit() {
+	return adaptive_run_limit;
+}
+
+int query_astar_adaptive_run_limit_time() {
+	return adaptive_run_limit_time;
+}
+
 // Caching
 //
 // The cache retains the pathfinding results that have been obtained so they
@@ -314,11 +594,50 @@ closure query_astar_run_limit_rule() {
 
 private mapping cache;
 
+// The expiry index: a mapping of bucket numbers to mappings of the cache
+// entries whose lifespans, as astar_prune_cache() figures them, end within
+// the bucket, so pruning need only look at entries that might be expiring.
+
+private mapping cache_expiry;
+
+// The node index: a mapping of validate keys to mappings of node keys to
+// mappings of the cache entries whose paths pass through the node to the
+// node's position in the path.  It is kept when subpath caching or targeted
+// invalidation is on; see the notes on those below.
+
+private mapping node_index;
+private int subpath_caching;
+private int targeted_invalidation;
+
+// The cache entries recording that no path could be found, kept when
+// targeted invalidation is on.
+
+private mapping cache_impossible;
+
+// The number of entries in the cache and the approximate memory they use, in
+// bytes; see the notes on cache limits below.
+
+private int cache_entries;
+private int cache_bytes;
+
 void set_astar_caching(int val) {
-	if(val)
+	if(val) {
 		cache = ([]);
-	else
+		cache_expiry = ([]);
+		if(node_index)
+			node_index = ([]);
+		if(cache_impossible)
+			cache_impossible = ([]);
+	} else {
 		cache = 0;
+		cache_expiry = 0;
+		node_index = 0;
+		cache_impossible = 0;
+		subpath_caching = 0;
+		targeted_invalidation = 0;
+	}
+	cache_entries = 0;
+	cache_bytes = 0;
 }
 
 int query_astar_caching() {
@@ -329,6 +648,188 @@ mapping query_astar_cache() {
 	return cache;
 }
 
+// Cache limits
+//
+// By default the cache grows until astar_prune_cache() is used to trim it.
+// With set_astar_cache_limit(max_entries), or
+// set_astar_cache_limit(max_entries, max_bytes), entries are evicted as new
+// ones are stored whenever the cache holds more than 'max_entries' entries
+// or, if 'max_bytes' is given, more than approximately that many bytes of
+// paths.  A limit of 0 means no limit.  Which entries are evicted is
+// decided by the eviction policy, set with set_astar_cache_eviction() to
+// one of the Astar_Cache_Eviction_* values from astar.h; the default is
+// Astar_Cache_Eviction_Expiry.
+//
+// query_astar_cache_size() gives the number of entries in the cache and
+// query_astar_cache_bytes() the approximate memory they take, which
+// counts the path's nodes and edges and the cache's own bookkeeping but
+// not anything nodes and edges point to.
+
+private int cache_limit;
+private int cache_byte_limit;
+private int cache_eviction;
+
+varargs void set_astar_cache_limit(int max_entries, int max_bytes) {
+	cache_limit = max_entries;
+	cache_byte_limit = max_bytes;
+}
+
+int query_astar_cache_limit() {
+	return cache_limit;
+}
+
+int query_astar_cache_byte_limit() {
+	return cache_byte_limit;
+}
+
+void set_astar_cache_eviction(int val) {
+	cache_eviction = val;
+}
+
+int query_astar_cache_eviction() {
+	return cache_eviction;
+}
+
+int query_astar_cache_size() {
+	return cache_entries;
+}
+
+int query_astar_cache_bytes() {
+	return cache_bytes;
+}
+
+// Subpath caching
+//
+// With subpath caching on, the cache keeps an index of the nodes along
+// each path it holds, so that a request for a path between any two nodes
+// along a cached path can be answered with the portion of the cached path
+// between them.  If a path is the best path between its endpoints, any
+// portion of it is also the best path between its own endpoints, so when
+// most paths follow a few common routes, this turns a great many cache
+// misses into hits.  (Paths are the best paths when found using
+// Astar_Pathfind_Control_Flag_Decrease_Key with a distance rule that never
+// overestimates; otherwise, portions of paths are about as good as the
+// paths they come from.)  One would use set_astar_subpath_caching(1), with
+// caching turned on, to turn on subpath caching.  Only paths cached while
+// it is on are indexed.
+//
+// Subpath caching should not be used with a completion rule that accepts
+// nodes other than the target node, since the portions of paths it would
+// return don't take the completion rule into account.
+
+void set_astar_subpath_caching(int val) {
+	if(val && !cache)
+		raise_error("set_astar_subpath_caching() called with caching off");
+	subpath_caching = val;
+	if(subpath_caching || targeted_invalidation)
+		node_index ||= ([]);
+	else
+		node_index = 0;
+}
+
+int query_astar_subpath_caching() {
+	return subpath_caching;
+}
+
+// Targeted invalidation
+//
+// With targeted invalidation on, the cache keeps an index of the nodes
+// along each path it holds, as it does for subpath caching, so that when
+// something about the graph changes -- an exit is added or removed, a
+// door is locked -- astar_invalidate_node() and astar_invalidate_edge() can
+// drop only the cache entries affected, rather than all of them as
+// astar_clear_cache() does.  One would use set_astar_targeted_invalidation(1),
+// with caching turned on, to turn on targeted invalidation.  Only paths
+// cached while it is on are indexed.
+
+void set_astar_targeted_invalidation(int val) {
+	if(val && !cache)
+		raise_error("set_astar_targeted_invalidation() called with caching off");
+	targeted_invalidation = val;
+	if(subpath_caching || targeted_invalidation)
+		node_index ||= ([]);
+	else
+		node_index = 0;
+	if(targeted_invalidation)
+		cache_impossible ||= ([]);
+	else
+		cache_impossible = 0;
+}
+
+int query_astar_targeted_invalidation() {
+	return targeted_invalidation;
+}
+
+// Apply edge rule
+//
+// The apply edge rule is used to find the node reached by following an
+// edge from a node.  It is called with the node and the edge as arguments,
+// and should return the node reached; for the coordinate nodes of
+// astar_2d.c, whose edges are offsets, that is just the sum of the two.
+// The rule is needed for compact caching.
+
+private closure apply_edge_rule;
+
+void set_astar_apply_edge_rule(closure val) {
+	apply_edge_rule = val;
+}
+
+closure query_astar_apply_edge_rule() {
+	return apply_edge_rule;
+}
+
+// Compact caching
+//
+// With compact caching on, the paths in the cache are stored with only
+// their starting node and their edges, and the rest of their nodes are
+// found again using the apply edge rule when they are requested.  When
+// nodes are large, like room filenames, this makes the cache much smaller
+// at the cost of some work on each cache hit.  One would use
+// set_astar_compact_caching(1), with caching turned on and an apply edge
+// rule defined, to turn on compact caching.  Only paths cached while it is
+// on are stored compactly.
+
+private int compact_caching;
+
+void set_astar_compact_caching(int val) {
+	if(val && !cache)
+		raise_error("set_astar_compact_caching() called with caching off");
+	if(val && !apply_edge_rule)
+		raise_error("set_astar_compact_caching() called with no apply edge rule");
+	compact_caching = val;
+}
+
+int query_astar_compact_caching() {
+	return compact_caching;
+}
+
+// Cache version
+//
+// astar_save_cache() writes the cache out to a file, and
+// astar_restore_cache() reads it back in, so that an instance can begin
+// with the paths it had before a reboot instead of an empty cache.  Paths
+// from before a change to the graph they were found in are no use, so a
+// snapshot is only restored into an instance with the same cache version
+// as the one that saved it, set with
+//
+//     set_astar_cache_version(version);
+//
+// where 'version' is any value save_value() can encode: a version number
+// bumped whenever the area is changed, or a checksum computed over its
+// layout, for instance.  The default is 0.  Node keys and validate keys
+// must likewise be values save_value() can encode, such as strings, ints
+// and arrays of them, for the snapshot to be of use.
+
+private mixed cache_version;
+
+void set_astar_cache_version(mixed val) {
+	cache_version = val;
+}
+
+mixed query_astar_cache_version() {
+	return cache_version;
+}
+
 // Validate key rule
 //
 // The validate key rule is only meaningful if you have caching turned on.
@@ -383,15 +884,172 @@ closure query_astar_scheduling_rule() {
 	return scheduling_rule;
 }
 
+// Central scheduling
+//
+// Each pathfind continued via the scheduling rule is scheduled on its own,
+// so with many pathfinds under way at once, their continuations run in
+// bursts and in no particular order.  With
+//
+//     set_astar_central_scheduling(1);
+//
+// continuations are instead handed to the scheduler daemon, astar_scheduler.c
+// (Astar_Scheduler_Daemon in astar.h), which keeps one queue for every
+// instance using it and spends a fixed budget of eval ticks each heartbeat
+// continuing the pathfinds in it: highest priority first, then earliest
+// deadline, then in turn.  The priority and deadline of a pathfind are given
+// to astar_find_path().  The scheduling rule is not used for pathfinds while
+// this is on, though astar_prune_cache() still uses it.
+
+private int central_scheduling;
+
+void set_astar_central_scheduling(int val) {
+	central_scheduling = val;
+}
+
+int query_astar_central_scheduling() {
+	return central_scheduling;
+}
+
+// Request coalescing
+//
+// When many objects want the same path at once, as when a crowd flees to
+// the same room, each request would otherwise search for it separately
+// until the first to finish fills the cache.  With
+//
+//     set_astar_request_coalescing(1);
+//
+// a request matching one already under way (with the same validate key,
+// starting and target node keys, and Decrease_Key, Bidirectional and
+// Goal_On_Pop control flags) does no searching of its own; its pathfind data structure is put
+// aside until the one doing the work finishes, and then receives the same
+// result and has its callback called as usual.  Only pathfinds continued
+// via the scheduling rule are joined this way, so requests need a callback
+// both to be joined and to be joinable.  Setting the Terminate control flag
+// on a request that has been joined to another takes effect when the other
+// finishes; if the one doing the work is terminated or cut off, the
+// requests joined to it carry on searching for themselves.  As with the
+// cache, this is only sound if 'validate' closures with the same validate
+// key accept the same nodes.
+
+private mapping in_flight;
+private int request_coalescing;
+
+void set_astar_request_coalescing(int val) {
+	request_coalescing = val;
+	in_flight = val ? ([]) : 0;
+}
+
+int query_astar_request_coalescing() {
+	return request_coalescing;
+}
+
+// Rule dependencies
+//
+// Paths under consideration are tracked internally as chains of search nodes
+// (see the Astar_Search_Node_* macros in astar.h) rather than full path data
+// structures, so pathfind[Astar_Pathfind_Active_Path] is normally left at 0.
+// A rule that needs the path leading to the active node can call
+// astar_active_path() with the pathfind data structure to have it assembled
+// on demand.  Alternatively, the instance can declare that its rules depend
+// on Astar_Pathfind_Active_Path with
+//
+//     set_astar_rule_dependencies(Astar_Rule_Dependency_Active_Path);
+//
+// and it will be assembled for every path the pathfinder works with, at a
+// cost in time and memory that grows with path length.  The flags available
+// are defined by the Astar_Rule_Dependency_* macros in astar.h; besides
+// Astar_Rule_Dependency_Active_Path, Astar_Rule_Dependency_Active_Edge
+// declares that the rules' results depend on the edge the active node was
+// reached by, which matters to neighbor caching (below).
+
+private int rule_dependencies;
+
+void set_astar_rule_dependencies(int val) {
+	rule_dependencies = val;
+}
+
+int query_astar_rule_dependencies() {
+	return rule_dependencies;
+}
+
+// Neighbor caching
+//
+// The neighbors rule is called whenever a node's neighbors are wanted, and
+// where that means loading rooms and looking over their exits, the same
+// work is done over and over by pathfinds through the same area.  With
+//
+//     set_astar_neighbor_caching(max_entries);
+//
+// the lists returned by the neighbors rule, batch neighbors rule and
+// reverse neighbors rule are kept by node key, up to about 'max_entries' of
+// them, with the least recently used going first, and reused in place of
+// calling the rules again.  Like the path cache, this is only sound if the
+// rules always give the same results for a node; if they depend on the
+// edge the node was reached by or the path leading to it, declare
+// Astar_Rule_Dependency_Active_Edge or Astar_Rule_Dependency_Active_Path
+// (see the notes on rule dependencies above) and lists won't be cached.
+// Lists for a node are dropped by astar_invalidate_node() and
+// astar_invalidate_edge(), along with those of its neighbors, and all of
+// them by astar_clear_cache().  set_astar_neighbor_caching(0) turns it off.
+
+private int neighbor_cache_limit;
+
+// The cached lists, as two generations of mappings of node keys to lists for
+// each direction of search, forward and backward: lists are added to the
+// current generation, and when it is full it becomes the previous one, in
+// place of the old previous one; lists found in the previous generation are
+// brought back into the current one as they are used.
+
+private mapping * neighbor_cache;
+private mapping * neighbor_cache_previous;
+
+void set_astar_neighbor_caching(int max_entries) {
+	neighbor_cache_limit = max_entries;
+	neighbor_cache = max_entries ? ({ ([]), ([]) }) : 0;
+	neighbor_cache_previous = max_entries ? ({ ([]), ([]) }) : 0;
+}
+
+int query_astar_neighbor_caching() {
+	return neighbor_cache_limit;
+}
+
+// Trace limit
+//
+// A pathfind run with Astar_Pathfind_Control_Flag_Trace keeps a record of
+// each node it expands, with the node key, the cost of the path to it, its
+// distance from the target and the processing cycle it happened in, and of
+// each cache lookup and store it makes; see astar_trace() and
+// astar_trace_render() for reading them.  Only the most recent records are
+// kept, up to the trace limit, set with set_astar_trace_limit(); the
+// default is Astar_Trace_Default_Limit, 1000.
+
+private int trace_limit = Astar_Trace_Default_Limit;
+
+void set_astar_trace_limit(int val) {
+	trace_limit = val;
+}
+
+int query_astar_trace_limit() {
+	return trace_limit;
+}
+
 // SECTION: Internal support functions
 //
 // These are functions used by the A* module.  Instances do not need to
 // interact with them.
 
+private void astar_pathfinder(mixed * pathfind);
+private void astar_pathfind_done(mixed * pathfind, mixed result);
+private void astar_prune_cache_continue(mixed * prune);
+private void astar_restore_cache_continue(mixed * restore);
+protected varargs mixed * astar_pathfind_create(mixed from, mixed to, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline, float weight);
+protected mixed * astar_pathfind_start(mixed * pathfind);
+
 // astar_path_sort()
 //
 // Sorting function for paths, based on their cost.  Sorts low-cost paths
-// to the end of the list.
+// to the end of the list.  Also serves as the comparator behind the open
+// list heap, by way of astar_path_precedes().
 //
 // Portability note: this function provides return values suitable for a
 // quicksort-style sorting algorithm; porting to drivers that implement
@@ -414,98 +1072,1607 @@ private int astar_path_sort(mixed * a, mixed * b) {
 		return 0;
 }
 
+// astar_path_precedes()
+//
+// Ordering test for the open list heap; true if path 'a' should be worked
+// with before path 'b'.  Works on search nodes as well as paths, and defers
+// to astar_path_sort() so that the heap and any sorting of path lists agree
+// on what "better" means, except that paths of equal cost are ordered by
+// the tie-breaking policy; the policies going by the order paths were
+// reached in only work on search nodes.
+
+private int astar_path_precedes(mixed * a, mixed * b) {
+	int order = astar_path_sort(a, b);
+	if(order || !tie_breaking)
+		return order > 0;
+	switch(tie_breaking) {
+	case Astar_Tie_Breaking_Low_Distance:
+		return a[Astar_Path_Distance] < b[Astar_Path_Distance];
+	case Astar_Tie_Breaking_High_Distance:
+		return a[Astar_Path_Distance] > b[Astar_Path_Distance];
+	case Astar_Tie_Breaking_First_Reached:
+		return a[Astar_Search_Node_Sequence] < b[Astar_Search_Node_Sequence];
+	case Astar_Tie_Breaking_Last_Reached:
+		return a[Astar_Search_Node_Sequence] > b[Astar_Search_Node_Sequence];
+	}
+	return 0;
+}
+
+// astar_open_sift_up()
+//
+// Moves the open list heap entry at position 'ix' toward the top of the heap
+// until it is in order, keeping each search node's Astar_Search_Node_Heap_Index
+// current as entries move.
+
+private void astar_open_sift_up(mixed * pathfind, int ix) {
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	int * heap = pathfind[Astar_Pathfind_Paths];
+	int index = heap[ix];
+	mixed * search_node = arena[index];
+	while(ix > 0) {
+		int parent = (ix - 1) >> 1;
+		if(!astar_path_precedes(search_node, arena[heap[parent]]))
+			break;
+		heap[ix] = heap[parent];
+		arena[heap[ix]][Astar_Search_Node_Heap_Index] = ix;
+		ix = parent;
+	}
+	heap[ix] = index;
+	search_node[Astar_Search_Node_Heap_Index] = ix;
+}
+
+// astar_open_push()
+//
+// Adds a search node, by arena index, to the open list heap in
+// Astar_Pathfind_Paths.  The heap array grows by doubling, so
+// Astar_Pathfind_Path_Count rather than the size of the array tells how
+// many entries are actually in it.
+
+private void astar_open_push(mixed * pathfind, int index) {
+	int * heap = pathfind[Astar_Pathfind_Paths];
+	int ix = pathfind[Astar_Pathfind_Path_Count]++;
+	if(ix >= sizeof(heap)) {
+		heap += allocate(sizeof(heap) || 1);
+		pathfind[Astar_Pathfind_Paths] = heap;
+	}
+	heap[ix] = index;
+	astar_open_sift_up(pathfind, ix);
+	if(ix + 1 + pathfind[Astar_Pathfind_Reverse_Path_Count] > pathfind[Astar_Pathfind_Stats_Peak_Open])
+		pathfind[Astar_Pathfind_Stats_Peak_Open] = ix + 1 + pathfind[Astar_Pathfind_Reverse_Path_Count];
+}
+
+// astar_open_pop()
+//
+// Removes the best search node on the open list heap and returns its arena
+// index.  The caller is responsible for checking Astar_Pathfind_Path_Count
+// first.
+
+private int astar_open_pop(mixed * pathfind) {
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	int * heap = pathfind[Astar_Pathfind_Paths];
+	int count = --pathfind[Astar_Pathfind_Path_Count];
+	int top = heap[0];
+	int last = heap[count];
+	mixed * search_node = arena[last];
+	arena[top][Astar_Search_Node_Heap_Index] = -1;
+	heap[count] = 0;
+	if(count) {
+		int ix = 0;
+		for(;;) {
+			int child = (ix << 1) + 1;
+			if(child >= count)
+				break;
+			if(child + 1 < count && astar_path_precedes(arena[heap[child + 1]], arena[heap[child]]))
+				child++;
+			if(!astar_path_precedes(arena[heap[child]], search_node))
+				break;
+			heap[ix] = heap[child];
+			arena[heap[ix]][Astar_Search_Node_Heap_Index] = ix;
+			ix = child;
+		}
+		heap[ix] = last;
+		search_node[Astar_Search_Node_Heap_Index] = ix;
+	}
+	return top;
+}
+
+// astar_search_node_add()
+//
+// Adds a search node to the pathfind's arena and returns its index.  Like
+// the open list heap, the arena grows by doubling, and
+// Astar_Pathfind_Search_Node_Count tells how much of it is in use.
+
+private int astar_search_node_add(mixed * pathfind, mixed node, mixed key, mixed edge, float distance, float cost, int parent) {
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	int index = pathfind[Astar_Pathfind_Search_Node_Count]++;
+	if(index >= sizeof(arena)) {
+		arena += allocate(sizeof(arena) || 1);
+		pathfind[Astar_Pathfind_Search_Nodes] = arena;
+	}
+	mixed * search_node = allocate(Astar_Search_Node_Fields);
+	search_node[Astar_Search_Node_Node] = node;
+	search_node[Astar_Search_Node_Edge] = edge;
+	search_node[Astar_Search_Node_Distance] = distance;
+	search_node[Astar_Search_Node_Cost] = cost;
+	search_node[Astar_Search_Node_Parent] = parent;
+	search_node[Astar_Search_Node_Key] = key;
+	search_node[Astar_Search_Node_Heap_Index] = -1;
+	search_node[Astar_Search_Node_Sequence] = index;
+	arena[index] = search_node;
+	return index;
+}
+
+// astar_search_path()
+//
+// Assembles the path data structure leading to a search node, given its
+// arena index, by following the chain of parent indices back to the start.
+
+private mixed * astar_search_path(mixed * pathfind, int index) {
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	mixed * search_node = arena[index];
+	int length = 1;
+	int ix;
+	for(ix = search_node[Astar_Search_Node_Parent]; ix != -1; ix = arena[ix][Astar_Search_Node_Parent])
+		length++;
+	mixed * nodes = allocate(length);
+	mixed * edges = allocate(length - 1);
+	for(ix = index; ix != -1; ix = arena[ix][Astar_Search_Node_Parent]) {
+		mixed * step = arena[ix];
+		nodes[--length] = step[Astar_Search_Node_Node];
+		if(length)
+			edges[length - 1] = step[Astar_Search_Node_Edge];
+	}
+	mixed * path = allocate(Astar_Path_Fields);
+	path[Astar_Path_Nodes] = nodes;
+	path[Astar_Path_Edges] = edges;
+	path[Astar_Path_Distance] = search_node[Astar_Search_Node_Distance];
+	path[Astar_Path_Cost] = search_node[Astar_Search_Node_Cost];
+	return path;
+}
+
+// astar_elapsed()
+//
+// Returns the number of microseconds since 'since', a utime() value.
+
+private int astar_elapsed(int * since) {
+	int * now = utime();
+	return (now[0] - since[0]) * 1000000 + now[1] - since[1];
+}
+
 // astar_distance()
 //
 // Distance retrieval process.  The distance rule is allowed to return -1
 // if, for whatever reason, it doesn't know how far it is between nodes;
-// the cost of the new path is set to be one greater than the cost of the
-// path it extends.
+// the distance of the new path is set to be one greater than the distance
+// of the path it extends.
 
 private float astar_distance(mixed * pathfind) {
-	if(!distance_rule)
-		return pathfind[Astar_Pathfind_Active_Path][Astar_Path_Distance] + 1.0;
-	mixed res = funcall(distance_rule, pathfind);
-	if(res == -1)
-		return pathfind[Astar_Pathfind_Active_Path][Astar_Path_Distance] + 1.0;
-	else
-		return res;
+	mapping targets = pathfind[Astar_Pathfind_Targets];
+	if(targets && !targets_distance_rule) {
+		if(distance_rule) {
+			// The distance to the nearest target, if the distance to every one of them can be determined
+			int * started = (pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Timing) && utime();
+			mixed to = pathfind[Astar_Pathfind_To];
+			mixed best = 0;
+			foreach(mixed target_key, mixed target : targets) {
+				pathfind[Astar_Pathfind_To] = target;
+				mixed res = funcall(distance_rule, pathfind);
+				if(res == -1) {
+					best = 0;
+					break;
+				}
+				if(!floatp(best) || res < best)
+					best = to_float(res);
+			}
+			pathfind[Astar_Pathfind_To] = to;
+			if(started)
+				pathfind[Astar_Pathfind_Stats_Distance_Time] += astar_elapsed(started);
+			if(floatp(best))
+				return best * pathfind[Astar_Pathfind_Heuristic_Weight];
+		}
+	} else if(targets ? targets_distance_rule : (pathfind[Astar_Pathfind_Direction] && reverse_distance_rule) || distance_rule) {
+		// The backward search of a bidirectional pathfind estimates distances from the starting node instead.
+		closure rule = targets ? targets_distance_rule : (pathfind[Astar_Pathfind_Direction] && reverse_distance_rule) || distance_rule;
+		mixed res;
+		if(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Timing) {
+			int * started = utime();
+			res = funcall(rule, pathfind);
+			pathfind[Astar_Pathfind_Stats_Distance_Time] += astar_elapsed(started);
+		} else {
+			res = funcall(rule, pathfind);
+		}
+		if(res != -1)
+			return res * pathfind[Astar_Pathfind_Heuristic_Weight];
+	}
+	return pathfind[Astar_Pathfind_Search_Nodes][pathfind[Astar_Pathfind_Active_Index]][Astar_Search_Node_Distance] + 1.0;
 }
 
 // astar_key()
 //
 // Node key retrieval process.  Finds the representation to use for the
-// node in checking visited status.
-
-private mixed astar_key(mixed node) {
-	return node_key_rule ? funcall(node_key_rule, node) : node;
+// node in checking visited status.  'pathfind' may be 0 when there is no
+// pathfind involved.
+
+private mixed astar_key(mixed * pathfind, mixed node) {
+	if(bounded_size) {
+		int key = 0;
+		for(int ix = 0; ix < sizeof(bounded_dimensions); ix++) {
+			int offset = node[ix] - bounded_min[ix];
+			if(offset < 0 || offset >= bounded_dimensions[ix])
+				raise_error("Node outside bounded space");
+			key = key * bounded_dimensions[ix] + offset;
+		}
+		return key;
+	}
+	if(!node_key_rule)
+		return node;
+	if(!pathfind || !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Timing))
+		return funcall(node_key_rule, node);
+	int * started = utime();
+	mixed key = funcall(node_key_rule, node);
+	pathfind[Astar_Pathfind_Stats_Node_Key_Time] += astar_elapsed(started);
+	return key;
 }
 
-// astar_cached_path()
+// astar_search_chain()
 //
-// Cached path retrieval.
+// Returns the search nodes making up the path leading to a search node,
+// given its arena index, in order from the start of the path.
+
+private mixed * astar_search_chain(mixed * pathfind, int index) {
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	int length = 0;
+	int ix;
+	for(ix = index; ix != -1; ix = arena[ix][Astar_Search_Node_Parent])
+		length++;
+	mixed * chain = allocate(length);
+	for(ix = index; ix != -1; ix = arena[ix][Astar_Search_Node_Parent])
+		chain[--length] = arena[ix];
+	return chain;
+}
 
-private mixed astar_cached_path(mixed * pathfind) {
-	if(!cache)
-		return 0;
-	closure validate = pathfind[Astar_Pathfind_Validate];
-	mixed validate_key = validate && validate_key_rule && funcall(validate_key_rule, pathfind);
-	if(validate && !validate_key)
-		return 0;
-	mapping validate_cache = cache[validate_key];
-	if(!validate_cache)
-		return 0;
-	mapping from_cache = validate_cache[astar_key(pathfind[Astar_Pathfind_From])];
-	if(!from_cache)
-		return 0;
-	mixed entry = from_cache[astar_key(pathfind[Astar_Pathfind_To])];
-	if(!entry)
-		return 0;
-	entry[Astar_Cache_Hits]++;
-	entry[Astar_Cache_Timestamp] = time();
-	return entry;
+// astar_neighbors_recall()
+//
+// Returns the cached neighbor list for the node with the given key in the
+// given direction of search, or 0 if there isn't one.
+
+private mixed * astar_neighbors_recall(int direction, mixed key) {
+	mixed * list = neighbor_cache[direction][key];
+	if(list)
+		return list;
+	list = neighbor_cache_previous[direction][key];
+	if(list) {
+		map_delete(neighbor_cache_previous[direction], key);
+		neighbor_cache[direction][key] = list;
+	}
+	return list;
 }
 
-// astar_pathfind_done()
+// astar_neighbors_remember()
 //
-// Internal function for handling the end of a pathfind.
+// Caches a neighbor list for the node with the given key in the given
+// direction of search, retiring the current generation of the neighbor
+// cache if it is full.
+
+private void astar_neighbors_remember(int direction, mixed key, mixed * list) {
+	if(sizeof(neighbor_cache[direction]) >= (neighbor_cache_limit + 1) / 2) {
+		neighbor_cache_previous[direction] = neighbor_cache[direction];
+		neighbor_cache[direction] = ([]);
+	}
+	neighbor_cache[direction][key] = list;
+}
 
-private void astar_pathfind_done(mixed * pathfind, mixed result) {
-	pathfind[Astar_Pathfind_Result] = result;
-	if(pathfind[Astar_Pathfind_Callback] && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Silent))
-		funcall(pathfind[Astar_Pathfind_Callback], pathfind);
+// astar_neighbors_forget()
+//
+// Drops the cached neighbor lists for the node with the given key in the
+// given direction of search, returning the list that was cached, if any.
+
+private mixed * astar_neighbors_forget(int direction, mixed key) {
+	mixed * list = neighbor_cache[direction][key] || neighbor_cache_previous[direction][key];
+	map_delete(neighbor_cache[direction], key);
+	map_delete(neighbor_cache_previous[direction], key);
+	return list;
 }
 
-// astar_pathfind_close()
+// astar_cache_index()
 //
-// Internal function for handling the end of a pathfind.
+// Adds a cache entry to the node index.
+
+private void astar_cache_index(mixed * entry) {
+	mapping index = node_index[entry[Astar_Cache_Validate_Key]] ||= ([]);
+	mixed * keys = entry[Astar_Cache_Keys];
+	int count = sizeof(keys);
+	for(int ix = 0; ix < count; ix++) {
+		mapping positions = index[keys[ix]] ||= ([]);
+		positions[entry] = ix;
+	}
+}
 
-private void astar_pathfind_close(mixed * pathfind, mixed result) {
-	if(cache && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Uncache)) {
-		// Calculate validate key beforehand in case the callback changes anything that interferes with generating it
-		closure validate = pathfind[Astar_Pathfind_Validate];
-		mixed validate_key = validate && validate_key_rule && funcall(validate_key_rule, pathfind);
-		astar_pathfind_done(pathfind, result);
-		if((validate_key || !validate) && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Uncache)) {
-			mapping validate_cache = cache[validate_key] ||= ([]);
-			mixed from_key = astar_key(pathfind[Astar_Pathfind_From]);
-			mapping from_cache = validate_cache[from_key] ||= ([]);
-			mixed to_key = astar_key(pathfind[Astar_Pathfind_To]);
-			mixed entry = allocate(Astar_Cache_Fields);
-			entry[Astar_Cache_Path] = pointerp(result) && result;
-			entry[Astar_Cache_Timestamp] = time();
-			from_cache[to_key] = entry;
-		}
-	} else {
-		astar_pathfind_done(pathfind, result);
+// astar_cache_unindex()
+//
+// Removes a cache entry from the node index, if it is in it.
+
+private void astar_cache_unindex(mixed * entry) {
+	if(cache_impossible)
+		map_delete(cache_impossible, entry);
+	mixed * keys = entry[Astar_Cache_Keys];
+	if(!node_index || !keys)
+		return;
+	mixed validate_key = entry[Astar_Cache_Validate_Key];
+	mapping index = node_index[validate_key];
+	if(!index)
+		return;
+	foreach(mixed key : keys) {
+		mapping positions = index[key];
+		if(!positions)
+			continue;
+		map_delete(positions, entry);
+		if(!sizeof(positions))
+			map_delete(index, key);
 	}
+	if(!sizeof(index))
+		map_delete(node_index, validate_key);
 }
 
-// astar_pathfinder()
+// astar_edge_matches()
 //
-// Performs the actual work of path calculation; takes a fully
-// initialized (and maybe partially processed) pathfind data structure
-// as argument.  Can resume from any point in the pathfinding
-// process, which is what lets the algorithm suspend activity when
+// Compares two edges by value, element by element for array edges.
+
+private int astar_edge_matches(mixed a, mixed b) {
+	if(!pointerp(a) || !pointerp(b))
+		return a == b;
+	if(sizeof(a) != sizeof(b))
+		return 0;
+	for(int ix = 0; ix < sizeof(a); ix++)
+		if(!astar_edge_matches(a[ix], b[ix]))
+			return 0;
+	return 1;
+}
+
+// astar_cache_expiry()
+//
+// Returns the time() at which a cache entry's lifespan ends, for pruning
+// purposes: its most recent hit, extended by its number of hits.
+
+private int astar_cache_expiry(mixed * entry) {
+	return entry[Astar_Cache_Timestamp] + entry[Astar_Cache_Hits] * Astar_Prune_Cache_Hit_Factor;
+}
+
+// astar_cache_file_expiry()
+//
+// Files a cache entry in the expiry index, in the bucket for its expiry.
+
+private void astar_cache_file_expiry(mixed * entry) {
+	int bucket = astar_cache_expiry(entry) / Astar_Prune_Cache_Bucket_Size;
+	mapping entries = cache_expiry[bucket];
+	if(!entries) {
+		entries = ([]);
+		cache_expiry[bucket] = entries;
+	}
+	entries[entry] = 1;
+	entry[Astar_Cache_Expiry_Bucket] = bucket;
+}
+
+// astar_cache_unfile_expiry()
+//
+// Removes a cache entry from the expiry index.
+
+private void astar_cache_unfile_expiry(mixed * entry) {
+	int bucket = entry[Astar_Cache_Expiry_Bucket];
+	mapping entries = cache_expiry[bucket];
+	if(!entries)
+		return;
+	map_delete(entries, entry);
+	if(!sizeof(entries))
+		map_delete(cache_expiry, bucket);
+}
+
+// astar_cache_touch()
+//
+// Credits a cache entry with a hit, refiling it in the expiry index.
+
+private void astar_cache_touch(mixed * entry) {
+	astar_cache_unfile_expiry(entry);
+	entry[Astar_Cache_Hits]++;
+	entry[Astar_Cache_Timestamp] = time();
+	astar_cache_file_expiry(entry);
+}
+
+// astar_cache_remove()
+//
+// Removes a cache entry from the cache and its indices.
+
+private void astar_cache_remove(mixed * entry) {
+	astar_cache_unfile_expiry(entry);
+	astar_cache_unindex(entry);
+	mixed validate_key = entry[Astar_Cache_Validate_Key];
+	mixed from_key = entry[Astar_Cache_From_Key];
+	mapping validate_cache = cache[validate_key];
+	mapping from_cache = validate_cache && validate_cache[from_key];
+	if(!from_cache || from_cache[entry[Astar_Cache_To_Key]] != entry)
+		return;
+	cache_entries--;
+	cache_bytes -= entry[Astar_Cache_Size];
+	map_delete(from_cache, entry[Astar_Cache_To_Key]);
+	if(!sizeof(from_cache))
+		map_delete(validate_cache, from_key);
+	if(!sizeof(validate_cache))
+		map_delete(cache, validate_key);
+}
+
+// astar_cache_entry_size()
+//
+// Returns the approximate memory used by a cache entry, in bytes.
+
+private int astar_cache_entry_size(mixed * entry) {
+	int values = Astar_Cache_Fields;
+	int arrays = 1;
+	mixed * path = entry[Astar_Cache_Path];
+	if(path) {
+		values += Astar_Path_Fields + sizeof(path[Astar_Path_Nodes]) + sizeof(path[Astar_Path_Edges]);
+		arrays += 3;
+	}
+	if(entry[Astar_Cache_Keys]) {
+		// Each key is held once in the entry and once in the subpath index, along with the index's position for it.
+		values += 3 * sizeof(entry[Astar_Cache_Keys]) + sizeof(entry[Astar_Cache_Costs]);
+		arrays += 2;
+	}
+	return values * Astar_Cache_Value_Bytes + arrays * Astar_Cache_Array_Bytes;
+}
+
+// astar_cache_evict()
+//
+// Evicts cache entries, other than 'keep', until the cache is within its
+// limits, choosing victims using the eviction policy from the earliest
+// bucket of the expiry index.
+
+private void astar_cache_evict(mixed * keep) {
+	// The buckets, earliest first, sorted once for all the evictions; 'position' is the earliest that may hold a victim.
+	int * buckets = 0;
+	int position = 0;
+	while((cache_limit && cache_entries > cache_limit) || (cache_byte_limit && cache_bytes > cache_byte_limit)) {
+		mixed * victim = 0;
+		buckets ||= sort_array(m_indices(cache_expiry), #'>);
+		for(; position < sizeof(buckets); position++) {
+			// Buckets are dropped from the index as they are emptied.
+			mapping entries = cache_expiry[buckets[position]];
+			if(!entries)
+				continue;
+			foreach(mixed * entry : m_indices(entries)) {
+				if(entry == keep)
+					continue;
+				if(!victim)
+					victim = entry;
+				else if(cache_eviction == Astar_Cache_Eviction_LRU && entry[Astar_Cache_Timestamp] < victim[Astar_Cache_Timestamp])
+					victim = entry;
+				else if(cache_eviction == Astar_Cache_Eviction_LFU && entry[Astar_Cache_Hits] < victim[Astar_Cache_Hits])
+					victim = entry;
+				if(cache_eviction == Astar_Cache_Eviction_Expiry)
+					break;
+			}
+			if(victim)
+				break;
+		}
+		if(!victim)
+			return;
+		astar_cache_remove(victim);
+	}
+}
+
+// astar_cache_store()
+//
+// Stores a cache entry, replacing any existing entry for the same validate
+// key and endpoints.  If the node index is kept and the entry holds a path,
+// 'chain' is the list of search nodes making up the path, as returned by
+// astar_search_chain(), which is used to index the entry.  If there is no
+// chain, the entry is indexed by the nodes of its path, but without the
+// costs along the path subpath caching needs, so it isn't used for that.
+
+private void astar_cache_store(mixed * pathfind, mixed * entry, mixed * chain) {
+	mapping validate_cache = cache[entry[Astar_Cache_Validate_Key]] ||= ([]);
+	mapping from_cache = validate_cache[entry[Astar_Cache_From_Key]] ||= ([]);
+	mixed * prior = from_cache[entry[Astar_Cache_To_Key]];
+	if(prior) {
+		astar_cache_unfile_expiry(prior);
+		astar_cache_unindex(prior);
+		cache_entries--;
+		cache_bytes -= prior[Astar_Cache_Size];
+	}
+	from_cache[entry[Astar_Cache_To_Key]] = entry;
+	astar_cache_file_expiry(entry);
+	if(node_index && entry[Astar_Cache_Path]) {
+		if(chain) {
+			int count = sizeof(chain);
+			mixed * keys = allocate(count);
+			float * costs = allocate(count);
+			for(int ix = 0; ix < count; ix++) {
+				keys[ix] = chain[ix][Astar_Search_Node_Key];
+				costs[ix] = chain[ix][Astar_Search_Node_Cost] - chain[ix][Astar_Search_Node_Distance];
+			}
+			entry[Astar_Cache_Keys] = keys;
+			entry[Astar_Cache_Costs] = costs;
+		} else if(!entry[Astar_Cache_Keys]) {
+			mixed * nodes = entry[Astar_Cache_Path][Astar_Path_Nodes];
+			int count = sizeof(nodes);
+			mixed * keys = allocate(count);
+			for(int ix = 0; ix < count; ix++)
+				keys[ix] = astar_key(pathfind, nodes[ix]);
+			entry[Astar_Cache_Keys] = keys;
+		}
+		astar_cache_index(entry);
+	} else if(cache_impossible && !entry[Astar_Cache_Path]) {
+		cache_impossible[entry] = 1;
+	}
+	if(compact_caching && entry[Astar_Cache_Path]) {
+		mixed * path = entry[Astar_Cache_Path];
+		mixed * compact = allocate(Astar_Path_Fields);
+		compact[Astar_Path_Nodes] = path[Astar_Path_Nodes][0 .. 0];
+		compact[Astar_Path_Edges] = path[Astar_Path_Edges];
+		compact[Astar_Path_Distance] = path[Astar_Path_Distance];
+		compact[Astar_Path_Cost] = path[Astar_Path_Cost];
+		entry[Astar_Cache_Path] = compact;
+		entry[Astar_Cache_Compact] = 1;
+	}
+	entry[Astar_Cache_Size] = astar_cache_entry_size(entry);
+	cache_entries++;
+	cache_bytes += entry[Astar_Cache_Size];
+	if(cache_limit || cache_byte_limit)
+		astar_cache_evict(entry);
+}
+
+// astar_cache_entry_path()
+//
+// Returns the path held by a cache entry, rebuilding its nodes with the
+// apply edge rule if it is stored in compact form.
+
+private mixed * astar_cache_entry_path(mixed * entry) {
+	mixed * path = entry[Astar_Cache_Path];
+	if(!entry[Astar_Cache_Compact])
+		return path;
+	mixed * edges = path[Astar_Path_Edges];
+	int count = sizeof(edges);
+	mixed * nodes = allocate(count + 1);
+	nodes[0] = path[Astar_Path_Nodes][0];
+	for(int ix = 0; ix < count; ix++)
+		nodes[ix + 1] = funcall(apply_edge_rule, nodes[ix], edges[ix]);
+	mixed * out = allocate(Astar_Path_Fields);
+	out[Astar_Path_Nodes] = nodes;
+	out[Astar_Path_Edges] = edges;
+	out[Astar_Path_Distance] = path[Astar_Path_Distance];
+	out[Astar_Path_Cost] = path[Astar_Path_Cost];
+	return out;
+}
+
+// astar_cached_subpath()
+//
+// Subpath retrieval from the subpath index.  Looks for cached paths that
+// pass through the 'from' node and later through the 'to' node, and if it
+// finds any, returns a cache entry holding the least costly portion of
+// one of them running between the two.  The entry returned is not itself
+// in the cache; the hit is credited to the entry the portion came from.
+
+private mixed astar_cached_subpath(mixed validate_key, mixed from_key, mixed to_key) {
+	mapping index = node_index[validate_key];
+	if(!index)
+		return 0;
+	mapping from_positions = index[from_key];
+	mapping to_positions = from_positions && index[to_key];
+	if(!to_positions)
+		return 0;
+	mixed * best = 0;
+	int best_from;
+	int best_to;
+	float best_cost;
+	foreach(mixed * candidate, int from_pos : from_positions) {
+		if(!member(to_positions, candidate))
+			continue;
+		int to_pos = to_positions[candidate];
+		float * costs = candidate[Astar_Cache_Costs];
+		if(to_pos <= from_pos || !costs)
+			continue;
+		float cost = costs[to_pos] - costs[from_pos];
+		if(best && cost >= best_cost)
+			continue;
+		best = candidate;
+		best_from = from_pos;
+		best_to = to_pos;
+		best_cost = cost;
+	}
+	if(!best)
+		return 0;
+	astar_cache_touch(best);
+	mixed * path = astar_cache_entry_path(best);
+	mixed * subpath = allocate(Astar_Path_Fields);
+	subpath[Astar_Path_Nodes] = path[Astar_Path_Nodes][best_from .. best_to];
+	subpath[Astar_Path_Edges] = path[Astar_Path_Edges][best_from .. best_to - 1];
+	subpath[Astar_Path_Distance] = best_to == sizeof(path[Astar_Path_Nodes]) - 1 ? path[Astar_Path_Distance] : 0.0;
+	subpath[Astar_Path_Cost] = best_cost + subpath[Astar_Path_Distance];
+	mixed * entry = allocate(Astar_Cache_Fields);
+	entry[Astar_Cache_Path] = subpath;
+	entry[Astar_Cache_Hits] = best[Astar_Cache_Hits];
+	entry[Astar_Cache_Timestamp] = best[Astar_Cache_Timestamp];
+	entry[Astar_Cache_Validate_Key] = validate_key;
+	entry[Astar_Cache_From_Key] = from_key;
+	entry[Astar_Cache_To_Key] = to_key;
+	return entry;
+}
+
+// astar_cache_lookup()
+//
+// Cache entry lookup for astar_cached_path().
+
+private mixed astar_cache_lookup(mixed * pathfind) {
+	closure validate = pathfind[Astar_Pathfind_Validate];
+	mixed validate_key = validate && validate_key_rule && funcall(validate_key_rule, pathfind);
+	if(validate && !validate_key)
+		return 0;
+	mapping validate_cache = cache[validate_key];
+	if(!validate_cache && !subpath_caching)
+		return 0;
+	mixed from_key = astar_key(pathfind, pathfind[Astar_Pathfind_From]);
+	mapping from_cache = validate_cache && validate_cache[from_key];
+	if(!from_cache && !subpath_caching)
+		return 0;
+	mixed to_key = astar_key(pathfind, pathfind[Astar_Pathfind_To]);
+	mixed entry = from_cache && from_cache[to_key];
+	if(!entry)
+		return subpath_caching && astar_cached_subpath(validate_key, from_key, to_key);
+	astar_cache_touch(entry);
+	if(!entry[Astar_Cache_Compact])
+		return entry;
+	// Hand back a copy holding the rebuilt path, leaving the entry itself compact.
+	mixed * expanded = copy(entry);
+	expanded[Astar_Cache_Path] = astar_cache_entry_path(entry);
+	expanded[Astar_Cache_Compact] = 0;
+	return expanded;
+}
+
+// astar_cached_path()
+//
+// Cached path retrieval.
+
+private mixed astar_cached_path(mixed * pathfind) {
+	if(!cache)
+		return 0;
+	mixed entry = astar_cache_lookup(pathfind);
+	pathfind[entry ? Astar_Pathfind_Stats_Cache_Hits : Astar_Pathfind_Stats_Cache_Misses]++;
+	astar_trace_cache(pathfind, entry ? Astar_Trace_Event_Cache_Hit : Astar_Trace_Event_Cache_Miss);
+	return entry;
+}
+
+// astar_coalesce_key()
+//
+// Returns the ({ validate key, from key, to key }) a pathfind can be
+// joined to others under, or 0 if it can't be.
+
+private mixed * astar_coalesce_key(mixed * pathfind) {
+	if(!pathfind[Astar_Pathfind_Callback] || pathfind[Astar_Pathfind_Neighbors_Rule] || pathfind[Astar_Pathfind_Result_Rule] || pathfind[Astar_Pathfind_Targets] || pathfind[Astar_Pathfind_Anytime_Step])
+		return 0;
+	if(pathfind[Astar_Pathfind_Control_Flags] & (Astar_Pathfind_Control_Flag_Uncache | Astar_Pathfind_Control_Flag_No_Continue))
+		return 0;
+	// A weighted pathfind's path may not be the cheapest, so it neither stands in for nor is stood in for by others.
+	if(pathfind[Astar_Pathfind_Heuristic_Weight] != 1.0)
+		return 0;
+	closure validate = pathfind[Astar_Pathfind_Validate];
+	mixed validate_key = validate && validate_key_rule && funcall(validate_key_rule, pathfind);
+	if(validate && !validate_key)
+		return 0;
+	return ({ validate_key, astar_key(pathfind, pathfind[Astar_Pathfind_From]), astar_key(pathfind, pathfind[Astar_Pathfind_To]) });
+}
+
+// astar_in_flight()
+//
+// Returns the pathfind under way for a coalescing key, if any.
+
+private mixed * astar_in_flight(mixed * key) {
+	mapping from_flight = in_flight[key[0]];
+	mapping to_flight = from_flight && from_flight[key[1]];
+	return to_flight && to_flight[key[2]];
+}
+
+// astar_coalesce_register()
+//
+// Makes a pathfind being continued via the scheduling rule available for
+// other requests to join, if there isn't another doing the same search.
+
+private void astar_coalesce_register(mixed * pathfind) {
+	if(!in_flight || pathfind[Astar_Pathfind_Coalesce_Key])
+		return;
+	mixed * key = astar_coalesce_key(pathfind);
+	if(!key || astar_in_flight(key))
+		return;
+	mapping from_flight = in_flight[key[0]] ||= ([]);
+	mapping to_flight = from_flight[key[1]] ||= ([]);
+	to_flight[key[2]] = pathfind;
+	pathfind[Astar_Pathfind_Coalesce_Key] = key;
+}
+
+// astar_coalesce_join()
+//
+// Joins a new pathfind to a matching one under way, if there is one,
+// returning true if it did.
+
+private int astar_coalesce_join(mixed * pathfind) {
+	if(!in_flight)
+		return 0;
+	mixed * key = astar_coalesce_key(pathfind);
+	mixed * leader = key && astar_in_flight(key);
+	if(!leader)
+		return 0;
+	int search_flags = Astar_Pathfind_Control_Flag_Decrease_Key | Astar_Pathfind_Control_Flag_Bidirectional | Astar_Pathfind_Control_Flag_Goal_On_Pop;
+	if((leader[Astar_Pathfind_Control_Flags] & search_flags) != (pathfind[Astar_Pathfind_Control_Flags] & search_flags))
+		return 0;
+	leader[Astar_Pathfind_Followers] = (leader[Astar_Pathfind_Followers] || ({})) + ({ pathfind });
+	pathfind[Astar_Pathfind_Result] = Astar_Result_Processing;
+	return 1;
+}
+
+// astar_coalesce_release()
+//
+// Takes a finished pathfind out of the coalescing index and passes its
+// result on to the requests joined to it; if it didn't get a result worth
+// sharing, they are started on their own, the first of them taking on the
+// rest if it has to be continued.
+
+private void astar_coalesce_release(mixed * pathfind) {
+	mixed * key = pathfind[Astar_Pathfind_Coalesce_Key];
+	if(key) {
+		pathfind[Astar_Pathfind_Coalesce_Key] = 0;
+		mapping from_flight = in_flight && in_flight[key[0]];
+		mapping to_flight = from_flight && from_flight[key[1]];
+		if(to_flight && to_flight[key[2]] == pathfind) {
+			map_delete(to_flight, key[2]);
+			if(!sizeof(to_flight))
+				map_delete(from_flight, key[1]);
+			if(!sizeof(from_flight))
+				map_delete(in_flight, key[0]);
+		}
+	}
+	mixed * followers = pathfind[Astar_Pathfind_Followers];
+	if(!followers)
+		return;
+	pathfind[Astar_Pathfind_Followers] = 0;
+	mixed result = pathfind[Astar_Pathfind_Result];
+	int shared = pointerp(result) || result == Astar_Result_Impossible;
+	while(sizeof(followers)) {
+		mixed * follower = followers[0];
+		followers = followers[1..];
+		if(follower[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Terminate) {
+			astar_pathfind_done(follower, Astar_Result_Terminated);
+		} else if(shared) {
+			astar_pathfind_done(follower, result);
+		} else {
+			astar_pathfind_start(follower);
+			if(follower[Astar_Pathfind_Result] == Astar_Result_Processing && follower[Astar_Pathfind_Coalesce_Key]) {
+				follower[Astar_Pathfind_Followers] = (follower[Astar_Pathfind_Followers] || ({})) + followers;
+				break;
+			}
+		}
+	}
+}
+
+// astar_pathfind_report()
+//
+// Internal function for reporting a finished pathfind to the metrics
+// daemon, astar_metrics.c, which keeps totals across all the objects using
+// the module.  An error in the daemon does not interfere with pathfinding.
+
+private void astar_pathfind_report(mixed * pathfind) {
+#ifndef Astar_Metrics_Disabled
+	mixed from_key = astar_key(pathfind, pathfind[Astar_Pathfind_From]);
+	mixed to_key = astar_key(pathfind, pathfind[Astar_Pathfind_To]);
+	catch(Astar_Metrics_Daemon->astar_metrics_report(pathfind, from_key, to_key));
+#endif
+}
+
+// astar_trace_record()
+//
+// Adds a trace record to a pathfind traced with
+// Astar_Pathfind_Control_Flag_Trace, in place of the oldest if the trace
+// limit has been reached.
+
+private void astar_trace_record(mixed * pathfind, int event, mixed key, float cost, float distance) {
+	mixed * trace = pathfind[Astar_Pathfind_Trace] ||= allocate(trace_limit > 0 ? trace_limit : 1);
+	mixed * record = allocate(Astar_Trace_Fields);
+	record[Astar_Trace_Event] = event;
+	record[Astar_Trace_Key] = key;
+	record[Astar_Trace_Cost] = cost;
+	record[Astar_Trace_Distance] = distance;
+	record[Astar_Trace_Cycle] = pathfind[Astar_Pathfind_Cycle_Index];
+	trace[pathfind[Astar_Pathfind_Trace_Count]++ % sizeof(trace)] = record;
+}
+
+// astar_trace_cache()
+//
+// Adds a trace record for a cache event concerning a pathfind's starting
+// and target nodes, if the pathfind is traced.
+
+private void astar_trace_cache(mixed * pathfind, int event) {
+	if(pathfind && (pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Trace))
+		astar_trace_record(pathfind, event, ({ astar_key(pathfind, pathfind[Astar_Pathfind_From]), astar_key(pathfind, pathfind[Astar_Pathfind_To]) }), 0.0, 0.0);
+}
+
+// astar_cycle_begin()
+//
+// Sets up the pathfind data structure for the start of a processing cycle,
+// for the run limit's purposes.  Modules building on this one call it, and
+// astar_run_limit_reached(), for work of their own done in cycles.
+
+protected void astar_cycle_begin(mixed * pathfind) {
+	pathfind[Astar_Pathfind_Cycle_Start] = utime();
+	pathfind[Astar_Pathfind_Cycle_Index]++;
+	pathfind[Astar_Pathfind_Cycle_Iterations] = 0;
+	pathfind[Astar_Pathfind_Cycle_Eval_Start] = get_eval_cost();
+	pathfind[Astar_Pathfind_Cycle_Next_Check] = 1;
+}
+
+// astar_run_limit_reached()
+//
+// Checks whether the current processing cycle should end, by the adaptive
+// run limit and the run limit rule.  Call it once per iteration, after
+// counting the iteration in pathfind[Astar_Pathfind_Cycle_Iterations].
+
+protected int astar_run_limit_reached(mixed * pathfind) {
+	int iterations = pathfind[Astar_Pathfind_Cycle_Iterations];
+	if((adaptive_run_limit || adaptive_run_limit_time) && iterations >= pathfind[Astar_Pathfind_Cycle_Next_Check]) {
+		// The number of iterations that look like they fit in what is left of the budget, at the rate seen so far
+		int done = iterations - 1;
+		int fit = Astar_Adaptive_Run_Limit_Max_Interval * 2;
+		int eval = get_eval_cost();
+		if(eval < Astar_Adaptive_Run_Limit_Reserve)
+			return 1;
+		if(adaptive_run_limit) {
+			int used = pathfind[Astar_Pathfind_Cycle_Eval_Start] - eval;
+			int remaining = min(adaptive_run_limit - used, eval - Astar_Adaptive_Run_Limit_Reserve);
+			if(remaining <= 0)
+				return 1;
+			if(done && used > 0)
+				fit = min(fit, remaining * done / used);
+		}
+		if(adaptive_run_limit_time) {
+			int used = astar_elapsed(pathfind[Astar_Pathfind_Cycle_Start]);
+			int remaining = adaptive_run_limit_time - used;
+			if(remaining <= 0)
+				return 1;
+			if(done && used > 0)
+				fit = min(fit, remaining * done / used);
+		}
+		if(done && fit < 1)
+			return 1;
+		pathfind[Astar_Pathfind_Cycle_Next_Check] = iterations + max(1, fit / 2);
+	}
+	return run_limit_rule && funcall(run_limit_rule, pathfind) && 1;
+}
+
+// astar_pathfind_partial()
+//
+// Internal function for a pathfind with Astar_Pathfind_Control_Flag_Partial
+// that is ending without a path, recording the path to the node nearest
+// the target among all those the pathfind reached, whether expanded or
+// still on the open list, in pathfind[Astar_Pathfind_Partial_Path].  Of
+// nodes equally near, the first reached is used.  For a bidirectional
+// pathfind, only the forward search is looked at.
+
+private void astar_pathfind_partial(mixed * pathfind) {
+	if(!(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Partial))
+		return;
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	int count = pathfind[Astar_Pathfind_Search_Node_Count];
+	if(!arena || !count)
+		return;
+	int best = 0;
+	for(int ix = 1; ix < count; ix++)
+		if(arena[ix][Astar_Search_Node_Distance] < arena[best][Astar_Search_Node_Distance])
+			best = ix;
+	mixed * path = astar_search_path(pathfind, best);
+	if(pathfind[Astar_Pathfind_Result_Rule])
+		path = funcall(pathfind[Astar_Pathfind_Result_Rule], pathfind, path);
+	pathfind[Astar_Pathfind_Partial_Path] = path;
+}
+
+// astar_pathfind_done()
+//
+// Internal function for handling the end of a pathfind.
+
+private void astar_pathfind_done(mixed * pathfind, mixed result) {
+	// An anytime pathfind that is terminated still has the best path it found to give.
+	if(result == Astar_Result_Terminated && pathfind[Astar_Pathfind_Incumbent])
+		result = pathfind[Astar_Pathfind_Incumbent];
+	if(result == Astar_Result_Terminated)
+		astar_pathfind_partial(pathfind);
+	pathfind[Astar_Pathfind_Result] = result;
+	astar_pathfind_report(pathfind);
+	if(pathfind[Astar_Pathfind_Callback] && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Silent))
+		funcall(pathfind[Astar_Pathfind_Callback], pathfind);
+	astar_coalesce_release(pathfind);
+}
+
+// astar_cache_entry_create()
+//
+// Sets up a cache entry recording 'result' as the result of pathfinding
+// between the pathfind's starting and target nodes.
+
+private mixed * astar_cache_entry_create(mixed * pathfind, mixed validate_key, mixed result) {
+	mixed * entry = allocate(Astar_Cache_Fields);
+	entry[Astar_Cache_Path] = pointerp(result) && result;
+	entry[Astar_Cache_Timestamp] = time();
+	entry[Astar_Cache_Validate_Key] = validate_key;
+	entry[Astar_Cache_From_Key] = astar_key(pathfind, pathfind[Astar_Pathfind_From]);
+	entry[Astar_Cache_To_Key] = astar_key(pathfind, pathfind[Astar_Pathfind_To]);
+	return entry;
+}
+
+// astar_pathfind_close()
+//
+// Internal function for handling the end of a pathfind.  If 'result' is a
+// path and subpath caching is on, 'chain' is the list of search nodes making
+// up the path, for indexing the cache entry.
+
+private varargs void astar_pathfind_close(mixed * pathfind, mixed result, mixed * chain) {
+	// A path from a result rule no longer matches the search nodes it came from.
+	if(pathfind[Astar_Pathfind_Result_Rule] && pointerp(result)) {
+		result = funcall(pathfind[Astar_Pathfind_Result_Rule], pathfind, result);
+		chain = 0;
+	}
+	// Paths found with a heuristic weight may not be the cheapest, so they aren't fit to hand to other requests.
+	if(cache && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Uncache) && pathfind[Astar_Pathfind_Heuristic_Weight] == 1.0) {
+		// Calculate validate key beforehand in case the callback changes anything that interferes with generating it
+		closure validate = pathfind[Astar_Pathfind_Validate];
+		mixed validate_key = validate && validate_key_rule && funcall(validate_key_rule, pathfind);
+		astar_pathfind_done(pathfind, result);
+		if((validate_key || !validate) && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Uncache)) {
+			astar_cache_store(pathfind, astar_cache_entry_create(pathfind, validate_key, result), chain);
+			astar_trace_cache(pathfind, Astar_Trace_Event_Cache_Store);
+		}
+	} else {
+		astar_pathfind_done(pathfind, result);
+	}
+}
+
+// astar_pathfind_suspend()
+//
+// Internal function for stopping a pathfind partway through.  If the
+// pathfind can continue via the scheduling rule, it is scheduled to;
+// otherwise its result is set to 'result'.
+
+private void astar_pathfind_suspend(mixed * pathfind, int result) {
+	if(pathfind[Astar_Pathfind_Callback] && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_No_Continue)) {
+		pathfind[Astar_Pathfind_Cycle_Index]++;
+		pathfind[Astar_Pathfind_Result] = Astar_Result_Processing;
+		astar_coalesce_register(pathfind);
+		if(central_scheduling)
+			Astar_Scheduler_Daemon->astar_scheduler_enqueue(#'astar_pathfinder, pathfind);
+		else
+			funcall(scheduling_rule, #'astar_pathfinder, 2, pathfind);
+	} else {
+		pathfind[Astar_Pathfind_Result] = result;
+		astar_pathfind_partial(pathfind);
+		astar_pathfind_report(pathfind);
+		astar_coalesce_release(pathfind);
+	}
+}
+
+// astar_pathfind_activate()
+//
+// Internal function for setting up the pathfind data structure to work
+// with the path ending at a search node, given its arena index.
+
+private mixed * astar_pathfind_activate(mixed * pathfind, int index) {
+	mixed * search_node = pathfind[Astar_Pathfind_Search_Nodes][index];
+	pathfind[Astar_Pathfind_Active_Index] = index;
+	if(rule_dependencies & Astar_Rule_Dependency_Active_Path)
+		pathfind[Astar_Pathfind_Active_Path] = astar_search_path(pathfind, index);
+	pathfind[Astar_Pathfind_Active_Node] = search_node[Astar_Search_Node_Node];
+	pathfind[Astar_Pathfind_Active_Edge] = search_node[Astar_Search_Node_Edge];
+	return search_node;
+}
+
+// astar_pathfind_seed()
+//
+// Internal function for setting up the search node arena, open list and
+// visited mapping of a pathfind with the path made up of its starting node.
+
+private void astar_pathfind_seed(mixed * pathfind) {
+	mixed from = pathfind[Astar_Pathfind_From];
+	// Set up our starting point based on the 'from' node
+	pathfind[Astar_Pathfind_Search_Nodes] = ({});
+	pathfind[Astar_Pathfind_Search_Node_Count] = 0;
+	mixed from_key = astar_key(pathfind, from);
+	int start = astar_search_node_add(pathfind, from, from_key, 0, 0.0, 0.0, -1);
+	pathfind[Astar_Pathfind_Active_Index] = start;
+	if(rule_dependencies & Astar_Rule_Dependency_Active_Path)
+		pathfind[Astar_Pathfind_Active_Path] = astar_search_path(pathfind, start);
+	mixed * search_node = pathfind[Astar_Pathfind_Search_Nodes][start];
+	search_node[Astar_Search_Node_Distance] = astar_distance(pathfind);
+	search_node[Astar_Search_Node_Cost] = search_node[Astar_Search_Node_Distance];
+	// Starting point becomes our open list, mapping to track where we've visited starts out populated with starting node
+	pathfind[Astar_Pathfind_Paths] = ({});
+	pathfind[Astar_Pathfind_Path_Count] = 0;
+	astar_open_push(pathfind, start);
+	pathfind[Astar_Pathfind_Goal_Bound] = 0;
+	if(bounded_size) {
+		pathfind[Astar_Pathfind_Visited] = allocate(bounded_size);
+		pathfind[Astar_Pathfind_Visited][from_key] = search_node;
+	} else {
+		pathfind[Astar_Pathfind_Visited] = ([
+			from_key : search_node,
+		]);
+	}
+}
+
+// astar_pathfind_refine()
+//
+// Internal function for handling a path found by a round of an anytime
+// pathfind.  Keeps the path if it is the best yet, and if there is time for
+// another round, tells the callback about the path and starts the round
+// with a lower heuristic weight, returning true; otherwise returns false,
+// and the pathfind should finish with pathfind[Astar_Pathfind_Incumbent].
+
+private int astar_pathfind_refine(mixed * pathfind, mixed * path) {
+	mixed * incumbent = pathfind[Astar_Pathfind_Incumbent];
+	int improved = !incumbent || path[Astar_Path_Cost] < incumbent[Astar_Path_Cost];
+	if(improved) {
+		pathfind[Astar_Pathfind_Incumbent] = path;
+		pathfind[Astar_Pathfind_Upper_Bound] = path[Astar_Path_Cost];
+	}
+	float weight = pathfind[Astar_Pathfind_Heuristic_Weight];
+	if(weight <= 1.0 || !pathfind[Astar_Pathfind_Callback])
+		return 0;
+	if(pathfind[Astar_Pathfind_Control_Flags] & (Astar_Pathfind_Control_Flag_No_Continue | Astar_Pathfind_Control_Flag_Terminate))
+		return 0;
+	if(pathfind[Astar_Pathfind_Deadline] && time() >= pathfind[Astar_Pathfind_Deadline])
+		return 0;
+	if(improved && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Silent)) {
+		pathfind[Astar_Pathfind_Result] = path;
+		funcall(pathfind[Astar_Pathfind_Callback], pathfind);
+	}
+	weight -= pathfind[Astar_Pathfind_Anytime_Step];
+	pathfind[Astar_Pathfind_Heuristic_Weight] = weight > 1.0 ? weight : 1.0;
+	astar_pathfind_seed(pathfind);
+	astar_pathfind_suspend(pathfind, Astar_Result_Cut_Off);
+	return 1;
+}
+
+// astar_open_rekey()
+//
+// Internal function for recalculating the distances of the paths on the
+// open list after the targets of a pathfind have changed, and putting the
+// open list heap back in order.  Each path's distance is found as it was
+// when the path was added, with the path it extends as the active path.
+
+private void astar_open_rekey(mixed * pathfind) {
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	int * heap = pathfind[Astar_Pathfind_Paths];
+	int count = pathfind[Astar_Pathfind_Path_Count];
+	for(int ix = 0; ix < count; ix++) {
+		mixed * search_node = arena[heap[ix]];
+		int parent = search_node[Astar_Search_Node_Parent];
+		pathfind[Astar_Pathfind_Active_Index] = parent == -1 ? heap[ix] : parent;
+		if(rule_dependencies & Astar_Rule_Dependency_Active_Path)
+			pathfind[Astar_Pathfind_Active_Path] = astar_search_path(pathfind, pathfind[Astar_Pathfind_Active_Index]);
+		pathfind[Astar_Pathfind_Active_Node] = search_node[Astar_Search_Node_Node];
+		pathfind[Astar_Pathfind_Active_Edge] = search_node[Astar_Search_Node_Edge];
+		float distance = astar_distance(pathfind);
+		search_node[Astar_Search_Node_Cost] += distance - search_node[Astar_Search_Node_Distance];
+		search_node[Astar_Search_Node_Distance] = distance;
+	}
+	for(int ix = 1; ix < count; ix++)
+		astar_open_sift_up(pathfind, ix);
+}
+
+// astar_batch_cache_entry()
+//
+// Internal function for setting aside a result found by one of the
+// pathfinds of astar_find_paths(), for the pathfind's current target, to be
+// cached when the batch completes.
+
+private void astar_batch_cache_entry(mixed * pathfind, mixed result, mixed * chain) {
+	mixed * batch = pathfind[Astar_Pathfind_Batch];
+	if(!cache || (batch[Astar_Batch_Control_Flags] & Astar_Pathfind_Control_Flag_Uncache) || pathfind[Astar_Pathfind_Heuristic_Weight] != 1.0)
+		return;
+	closure validate = pathfind[Astar_Pathfind_Validate];
+	mixed validate_key = validate && validate_key_rule && funcall(validate_key_rule, pathfind);
+	if(validate && !validate_key)
+		return;
+	batch[Astar_Batch_Cache_Entries] += ({ ({ astar_cache_entry_create(pathfind, validate_key, result), chain }) });
+}
+
+// astar_batch_collect()
+//
+// Internal function for handling a path found by a pathfind of
+// astar_find_paths() with several targets.  Records the path as the result
+// of the queries for the target it reached, and if targets remain, sets up
+// the pathfind to go on searching for the rest of them and returns true.
+
+private int astar_batch_collect(mixed * pathfind, mixed * path, int index) {
+	mixed * batch = pathfind[Astar_Pathfind_Batch];
+	mapping targets = pathfind[Astar_Pathfind_Targets];
+	mixed key = pathfind[Astar_Pathfind_Search_Nodes][index][Astar_Search_Node_Key];
+	foreach(int query : pathfind[Astar_Pathfind_Batch_Queries][key])
+		batch[Astar_Batch_Results][query] = path;
+	map_delete(pathfind[Astar_Pathfind_Batch_Queries], key);
+	pathfind[Astar_Pathfind_To] = targets[key];
+	astar_batch_cache_entry(pathfind, path, node_index && astar_search_chain(pathfind, index));
+	map_delete(targets, key);
+	if(!sizeof(targets))
+		return 0;
+	// The distances on the open list were to the nearest target, which may have been this one.
+	pathfind[Astar_Pathfind_To] = m_values(targets)[0];
+	astar_open_rekey(pathfind);
+	return 1;
+}
+
+// astar_batch_finish()
+//
+// Internal function for handling the end of astar_find_paths(), once every
+// query has its result.
+
+private void astar_batch_finish(mixed * batch) {
+	if(cache)
+		foreach(mixed * pending : batch[Astar_Batch_Cache_Entries])
+			astar_cache_store(0, pending[0], pending[1]);
+	batch[Astar_Batch_Cache_Entries] = ({});
+	if(batch[Astar_Batch_Callback] && !(batch[Astar_Batch_Control_Flags] & Astar_Pathfind_Control_Flag_Silent))
+		funcall(batch[Astar_Batch_Callback], batch);
+}
+
+// astar_batch_group_done()
+//
+// Internal function for handling the end of one of the pathfinds of
+// astar_find_paths(), giving its result to the queries still waiting on
+// it; for a pathfind with several targets, this is the outcome for the
+// targets it didn't reach.  Does nothing if called again for the same
+// pathfind.
+
+private void astar_batch_group_done(mixed * pathfind) {
+	if(!pathfind[Astar_Pathfind_Batch_Queries])
+		return;
+	mixed * batch = pathfind[Astar_Pathfind_Batch];
+	mixed result = pathfind[Astar_Pathfind_Result];
+	mapping targets = pathfind[Astar_Pathfind_Targets];
+	foreach(mixed key, int * queries : pathfind[Astar_Pathfind_Batch_Queries]) {
+		foreach(int query : queries)
+			batch[Astar_Batch_Results][query] = result;
+		// A search that ran out of paths has shown there is no way to the targets it didn't reach.
+		if(targets && result == Astar_Result_Impossible) {
+			pathfind[Astar_Pathfind_To] = targets[key];
+			astar_batch_cache_entry(pathfind, 0, 0);
+		}
+	}
+	pathfind[Astar_Pathfind_Batch_Queries] = 0;
+	if(!--batch[Astar_Batch_Pending])
+		astar_batch_finish(batch);
+}
+
+// astar_pathfind_reverse()
+//
+// Internal function for turning a bidirectional pathfind around, so that
+// the search that was not being worked with is.  Exchanges the starting and
+// target nodes, along with the two searches' open lists, search node arenas
+// and visited mappings, leaving the pathfind data structure set up for the
+// rest of the module to work with the other search as it would a forward
+// one.  Calling it again turns the pathfind back.
+
+private void astar_pathfind_reverse(mixed * pathfind) {
+	mixed swap;
+	swap = pathfind[Astar_Pathfind_From];
+	pathfind[Astar_Pathfind_From] = pathfind[Astar_Pathfind_To];
+	pathfind[Astar_Pathfind_To] = swap;
+	swap = pathfind[Astar_Pathfind_Visited];
+	pathfind[Astar_Pathfind_Visited] = pathfind[Astar_Pathfind_Reverse_Visited];
+	pathfind[Astar_Pathfind_Reverse_Visited] = swap;
+	swap = pathfind[Astar_Pathfind_Paths];
+	pathfind[Astar_Pathfind_Paths] = pathfind[Astar_Pathfind_Reverse_Paths];
+	pathfind[Astar_Pathfind_Reverse_Paths] = swap;
+	swap = pathfind[Astar_Pathfind_Path_Count];
+	pathfind[Astar_Pathfind_Path_Count] = pathfind[Astar_Pathfind_Reverse_Path_Count];
+	pathfind[Astar_Pathfind_Reverse_Path_Count] = swap;
+	swap = pathfind[Astar_Pathfind_Search_Nodes];
+	pathfind[Astar_Pathfind_Search_Nodes] = pathfind[Astar_Pathfind_Reverse_Search_Nodes];
+	pathfind[Astar_Pathfind_Reverse_Search_Nodes] = swap;
+	swap = pathfind[Astar_Pathfind_Search_Node_Count];
+	pathfind[Astar_Pathfind_Search_Node_Count] = pathfind[Astar_Pathfind_Reverse_Search_Node_Count];
+	pathfind[Astar_Pathfind_Reverse_Search_Node_Count] = swap;
+	pathfind[Astar_Pathfind_Direction] = !pathfind[Astar_Pathfind_Direction];
+}
+
+// astar_pathfind_meet()
+//
+// Internal function for noting that a search node reached by the search
+// being worked with in a bidirectional pathfind is for a node the other
+// search has also reached, as recorded by 'other'.  Keeps the meeting if it
+// makes for a cheaper complete path than the best one found so far.
+
+private void astar_pathfind_meet(mixed * pathfind, mixed * search_node, mixed * other) {
+	float cost = search_node[Astar_Search_Node_Cost] - search_node[Astar_Search_Node_Distance] + other[Astar_Search_Node_Cost] - other[Astar_Search_Node_Distance];
+	mixed * meeting = pathfind[Astar_Pathfind_Meeting];
+	if(meeting && meeting[Astar_Meeting_Cost] <= cost)
+		return;
+	meeting = allocate(Astar_Meeting_Fields);
+	meeting[Astar_Meeting_Forward] = pathfind[Astar_Pathfind_Direction] ? other : search_node;
+	meeting[Astar_Meeting_Backward] = pathfind[Astar_Pathfind_Direction] ? search_node : other;
+	meeting[Astar_Meeting_Cost] = cost;
+	pathfind[Astar_Pathfind_Meeting] = meeting;
+}
+
+// astar_forward_edge()
+//
+// Internal function for finding the edge used to move from 'node' to the
+// node with key 'key' in the forward direction, by looking up the neighbors
+// of 'node'.  Used for the backward portion of a bidirectional pathfind's
+// result when there is no reverse neighbors rule, since a backward search
+// using the neighbors rule records edges in the wrong direction.  Returns
+// 'edge' if no such neighbor can be found.
+
+private mixed astar_forward_edge(mixed * pathfind, mixed node, mixed key, mixed edge) {
+	mixed neighbors;
+	pathfind[Astar_Pathfind_Active_Node] = node;
+	pathfind[Astar_Pathfind_Active_Edge] = 0;
+	if(!pathfind[Astar_Pathfind_Neighbors_Rule] && batch_neighbors_rule) {
+		pathfind[Astar_Pathfind_Active_Nodes] = ({ node });
+		pathfind[Astar_Pathfind_Active_Edges] = ({ 0 });
+		neighbors = funcall(batch_neighbors_rule, pathfind);
+		pathfind[Astar_Pathfind_Active_Nodes] = 0;
+		pathfind[Astar_Pathfind_Active_Edges] = 0;
+		neighbors = pointerp(neighbors) && sizeof(neighbors) == 1 && neighbors[0];
+	} else {
+		neighbors = funcall(pathfind[Astar_Pathfind_Neighbors_Rule] || neighbors_rule, pathfind);
+	}
+	if(pointerp(neighbors))
+		foreach(mixed * neighbor : neighbors)
+			if(astar_key(pathfind, neighbor[0]) == key)
+				return neighbor[1];
+	return edge;
+}
+
+// astar_meeting_chain()
+//
+// Returns the search nodes making up the path through the best meeting of
+// a bidirectional pathfind's two searches, in order from the start of the
+// path, as astar_search_chain() does.  The backward search's portion is
+// represented by new search nodes holding the forward edges and costs.
+
+private mixed * astar_meeting_chain(mixed * pathfind) {
+	mixed * meeting = pathfind[Astar_Pathfind_Meeting];
+	mixed * forward = meeting[Astar_Meeting_Forward];
+	mixed * backward = meeting[Astar_Meeting_Backward];
+	mixed * arena = pathfind[Astar_Pathfind_Reverse_Search_Nodes];
+	closure reverse_source = !pathfind[Astar_Pathfind_Neighbors_Rule] && reverse_neighbors_rule;
+	float cost = forward[Astar_Search_Node_Cost] - forward[Astar_Search_Node_Distance] + backward[Astar_Search_Node_Cost] - backward[Astar_Search_Node_Distance];
+	mixed * chain = astar_search_chain(pathfind, member(pathfind[Astar_Pathfind_Search_Nodes], forward));
+	for(int ix = backward[Astar_Search_Node_Parent]; ix != -1; ix = arena[ix][Astar_Search_Node_Parent]) {
+		mixed * step = arena[ix];
+		mixed edge = backward[Astar_Search_Node_Edge];
+		if(!reverse_source)
+			edge = astar_forward_edge(pathfind, backward[Astar_Search_Node_Node], step[Astar_Search_Node_Key], edge);
+		mixed * search_node = allocate(Astar_Search_Node_Fields);
+		search_node[Astar_Search_Node_Node] = step[Astar_Search_Node_Node];
+		search_node[Astar_Search_Node_Edge] = edge;
+		search_node[Astar_Search_Node_Distance] = 0.0;
+		search_node[Astar_Search_Node_Cost] = cost - (step[Astar_Search_Node_Cost] - step[Astar_Search_Node_Distance]);
+		search_node[Astar_Search_Node_Parent] = -1;
+		search_node[Astar_Search_Node_Key] = step[Astar_Search_Node_Key];
+		search_node[Astar_Search_Node_Heap_Index] = -1;
+		chain += ({ search_node });
+		backward = step;
+	}
+	return chain;
+}
+
+// astar_chain_path()
+//
+// Assembles the path data structure for a list of search nodes in order
+// from the start of the path.
+
+private mixed * astar_chain_path(mixed * chain) {
+	int count = sizeof(chain);
+	mixed * nodes = allocate(count);
+	mixed * edges = allocate(count - 1);
+	for(int ix = 0; ix < count; ix++) {
+		nodes[ix] = chain[ix][Astar_Search_Node_Node];
+		if(ix)
+			edges[ix - 1] = chain[ix][Astar_Search_Node_Edge];
+	}
+	mixed * path = allocate(Astar_Path_Fields);
+	path[Astar_Path_Nodes] = nodes;
+	path[Astar_Path_Edges] = edges;
+	path[Astar_Path_Distance] = chain[<1][Astar_Search_Node_Distance];
+	path[Astar_Path_Cost] = chain[<1][Astar_Search_Node_Cost];
+	return path;
+}
+
+// Outcomes of a pass of the pathfinder, as returned by astar_pathfind_pass()
+
+// The pathfind should go on to another pass
+#define Astar_Pass_Continue                     0
+// The path ending at pathfind[Astar_Pathfind_Active_Index] is the result
+#define Astar_Pass_Complete                     1
+// The open list has been exhausted
+#define Astar_Pass_Exhausted                    2
+// The neighbors rule needs ongoing processing; the paths not yet extended are back on the open list
+#define Astar_Pass_Suspend                      3
+
+// astar_pathfind_pass()
+//
+// Performs one pass of the pathfinder: takes the paths at the best cost on
+// hand off the open list and extends them, returning one of the
+// Astar_Pass_* outcomes above.  'to_key' is the node key of the target node
+// and 'neighbors_source' and 'batch_source' the rules to retrieve neighbors
+// with.  For a bidirectional pathfind this works with whichever search the
+// pathfind is currently turned to, watching for nodes the other search has
+// reached rather than checking for completion.
+
+private int astar_pathfind_pass(mixed * pathfind, mixed to_key, closure neighbors_source, closure batch_source) {
+	mixed other_visited = pathfind[Astar_Pathfind_Reverse_Visited];
+	int decrease_key = (other_visited && 1) || (pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Decrease_Key);
+	int timing = pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Timing;
+	int tracing = pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Trace;
+	mapping targets = pathfind[Astar_Pathfind_Targets];
+	mixed upper_bound = pathfind[Astar_Pathfind_Upper_Bound];
+	float weight = pathfind[Astar_Pathfind_Heuristic_Weight];
+	// Neighbor lists can be cached if they come from the instance's rules and depend on nothing but the node.
+	int memoize = neighbor_cache_limit && !pathfind[Astar_Pathfind_Neighbors_Rule] && !(rule_dependencies & (Astar_Rule_Dependency_Active_Path | Astar_Rule_Dependency_Active_Edge));
+	int direction = pathfind[Astar_Pathfind_Direction];
+	// A pathfind for astar_find_paths() with several targets is done with each target it reaches, whatever the
+	// completion rule would say.
+	int collecting = targets && pathfind[Astar_Pathfind_Batch] && 1;
+	closure completion = !collecting && completion_rule;
+	// Checking for completion as paths come off the open list, rather than as they are reached
+	int pop_test = decrease_key || (pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Goal_On_Pop);
+	// The bound set by a path to the target on the open list, which doesn't apply to a search for several targets or
+	// one ended by the completion rule
+	int bounding = pop_test && !other_visited && !collecting && !completion;
+	mixed goal_bound = pathfind[Astar_Pathfind_Goal_Bound];
+	int * started;
+	// Pull the paths at the best cost on hand off the open list, and as good by the tie-breaking policy; we only want to
+	// deal with these.  Paths added while extending them wait for the next pass, even if they turn out to be just as good.
+	mixed * arena = pathfind[Astar_Pathfind_Search_Nodes];
+	int * heap = pathfind[Astar_Pathfind_Paths];
+	mixed * first = arena[heap[0]];
+	int * indices = ({});
+	while(pathfind[Astar_Pathfind_Path_Count] && !astar_path_precedes(first, arena[heap[0]]))
+		indices += ({ astar_open_pop(pathfind) });
+	int ix;
+	int * final = 0;
+	// If we're checking for completion as paths come off the open list, this is the time.  Everything we pulled
+	// has the same cost, so the first complete path is as good as any.
+	if(pop_test && !other_visited)
+		foreach(int index : indices) {
+			mixed * search_node = astar_pathfind_activate(pathfind, index);
+			if(completion ? funcall(completion, pathfind) : targets ? member(targets, search_node[Astar_Search_Node_Key]) : (search_node[Astar_Search_Node_Key] == to_key)) {
+				// Searching goes on past the target, so the paths we pulled go back on the open list.
+				if(collecting)
+					foreach(int pending : indices)
+						astar_open_push(pathfind, pending);
+				return Astar_Pass_Complete;
+			}
+		}
+	// If we have a batch neighbors rule, retrieve the neighbors for all of the paths we pulled at once, apart from
+	// those the neighbor cache already has.
+	mixed * batch = 0;
+	if(batch_source) {
+		int count = sizeof(indices);
+		batch = allocate(count);
+		int * wanted = ({});
+		for(ix = 0; ix < count; ix++) {
+			mixed list = memoize && astar_neighbors_recall(direction, arena[indices[ix]][Astar_Search_Node_Key]);
+			if(list)
+				batch[ix] = list;
+			else
+				wanted += ({ ix });
+		}
+		if(sizeof(wanted)) {
+			mixed * nodes = allocate(sizeof(wanted));
+			mixed * edges = allocate(sizeof(wanted));
+			for(int jx = 0; jx < sizeof(wanted); jx++) {
+				mixed * search_node = arena[indices[wanted[jx]]];
+				nodes[jx] = search_node[Astar_Search_Node_Node];
+				edges[jx] = search_node[Astar_Search_Node_Edge];
+			}
+			pathfind[Astar_Pathfind_Active_Nodes] = nodes;
+			pathfind[Astar_Pathfind_Active_Edges] = edges;
+			if(timing)
+				started = utime();
+			mixed neighbor_lists = funcall(batch_source, pathfind);
+			if(timing)
+				pathfind[Astar_Pathfind_Stats_Neighbors_Time] += astar_elapsed(started);
+			pathfind[Astar_Pathfind_Active_Nodes] = 0;
+			pathfind[Astar_Pathfind_Active_Edges] = 0;
+			if(!pointerp(neighbor_lists)) {
+				if(neighbor_lists == Astar_Result_Processing) {
+					// Return the paths we pulled to the open list so we can resume with them.
+					foreach(int index : indices)
+						astar_open_push(pathfind, index);
+					return Astar_Pass_Suspend;
+				} else {
+					raise_error("Invalid return value from batch neighbors rule");
+				}
+			}
+			if(sizeof(neighbor_lists) != sizeof(wanted))
+				raise_error("Wrong number of neighbor lists from batch neighbors rule");
+			for(int jx = 0; jx < sizeof(wanted); jx++) {
+				batch[wanted[jx]] = neighbor_lists[jx];
+				if(memoize && pointerp(neighbor_lists[jx]))
+					astar_neighbors_remember(direction, arena[indices[wanted[jx]]][Astar_Search_Node_Key], neighbor_lists[jx]);
+			}
+		}
+	}
+	// Check for possible extensions on all of the paths we pulled.
+	for(ix = 0; ix < sizeof(indices); ix++) {
+		int index = indices[ix];
+		mixed * search_node = astar_pathfind_activate(pathfind, index);
+		// Retrieve the list of neighbor nodes and edges to reach them.
+		mixed neighbors;
+		if(batch) {
+			neighbors = batch[ix];
+		} else if(memoize && (neighbors = astar_neighbors_recall(direction, search_node[Astar_Search_Node_Key]))) {
+			// The neighbor cache had them.
+		} else {
+			if(timing) {
+				started = utime();
+				neighbors = funcall(neighbors_source, pathfind);
+				pathfind[Astar_Pathfind_Stats_Neighbors_Time] += astar_elapsed(started);
+			} else {
+				neighbors = funcall(neighbors_source, pathfind);
+			}
+			if(memoize && pointerp(neighbors))
+				astar_neighbors_remember(direction, search_node[Astar_Search_Node_Key], neighbors);
+		}
+		if(!pointerp(neighbors)) {
+			if(!batch && neighbors == Astar_Result_Processing) {
+				// If we've already reached the target, there's no need to wait on the rest of the paths.
+				if(final)
+					break;
+				// Return the paths we haven't extended yet to the open list so we can resume with them.
+				foreach(int pending : indices[ix..])
+					astar_open_push(pathfind, pending);
+				return Astar_Pass_Suspend;
+			} else {
+				raise_error(batch ? "Invalid neighbor list from batch neighbors rule" : "Invalid return value from neighbors rule");
+			}
+		}
+		pathfind[Astar_Pathfind_Stats_Expanded]++;
+		if(tracing)
+			astar_trace_record(pathfind, direction ? Astar_Trace_Event_Expand_Backward : Astar_Trace_Event_Expand, search_node[Astar_Search_Node_Key], search_node[Astar_Search_Node_Cost] - search_node[Astar_Search_Node_Distance], search_node[Astar_Search_Node_Distance]);
+		pathfind[Astar_Pathfind_Stats_Generated] += sizeof(neighbors);
+		// The portion of the base path's cost that is not based on its distance from the target node.
+		float base_cost = search_node[Astar_Search_Node_Cost] - search_node[Astar_Search_Node_Distance];
+		foreach(mixed * neighbor : neighbors) {
+			mixed node = neighbor[0];
+			mixed edge = neighbor[1];
+			mixed ncost = neighbor[2];
+			// If we've already been here, never mind, unless we're looking for cheaper routes and this is one.
+			mixed key = astar_key(pathfind, node);
+			mixed * known = pathfind[Astar_Pathfind_Visited][key];
+			if(known && (!decrease_key || known[Astar_Search_Node_Cost] - known[Astar_Search_Node_Distance] <= base_cost + ncost)) {
+				pathfind[Astar_Pathfind_Stats_Duplicates]++;
+				continue;
+			}
+			// Register node and edge in pathfind structure.
+			pathfind[Astar_Pathfind_Active_Node] = node;
+			pathfind[Astar_Pathfind_Active_Edge] = edge;
+			// If we have a validation rule for nodes, check against it.
+			if(pathfind[Astar_Pathfind_Validate]) {
+				mixed valid;
+				if(timing) {
+					started = utime();
+					valid = funcall(pathfind[Astar_Pathfind_Validate], pathfind);
+					pathfind[Astar_Pathfind_Stats_Validate_Time] += astar_elapsed(started);
+				} else {
+					valid = funcall(pathfind[Astar_Pathfind_Validate], pathfind);
+				}
+				if(!valid) {
+					pathfind[Astar_Pathfind_Stats_Rejected]++;
+					continue;
+				}
+			}
+			// If the other search of a bidirectional pathfind has been here, we have a way through.
+			mixed * other = other_visited && other_visited[key];
+			// This is now a valid extension.  The cost of the extended path is its distance from the target node, plus the
+			// portion of the base path's cost that is not based on its distance, plus the cost of the edge.
+			float distance = known ? known[Astar_Search_Node_Distance] : astar_distance(pathfind);
+			// Once an anytime pathfind has a path, paths that can't come in under its cost aren't worth going on with.
+			if(upper_bound && base_cost + ncost + distance / weight >= upper_bound)
+				continue;
+			// Likewise once a path to the target is waiting on the open list.
+			if(bounding) {
+				if(targets ? member(targets, key) : (key == to_key)) {
+					if(!goal_bound || base_cost + ncost < goal_bound)
+						goal_bound = pathfind[Astar_Pathfind_Goal_Bound] = base_cost + ncost;
+				} else if(goal_bound && base_cost + ncost + distance / weight >= goal_bound) {
+					continue;
+				}
+			}
+			if(known) {
+				// A cheaper route to a node still on the open list replaces the route its entry was reached by.
+				if(known[Astar_Search_Node_Heap_Index] != -1) {
+					known[Astar_Search_Node_Edge] = edge;
+					known[Astar_Search_Node_Parent] = index;
+					known[Astar_Search_Node_Cost] = base_cost + distance + ncost;
+					astar_open_sift_up(pathfind, known[Astar_Search_Node_Heap_Index]);
+					if(other)
+						astar_pathfind_meet(pathfind, known, other);
+					continue;
+				}
+				// Otherwise the node has already been worked with, and is reopened below by way of a new search node.
+			}
+			// Record a search node for the extended path; okay, then, now we've been here.
+			int ext = astar_search_node_add(pathfind, node, key, edge, distance, base_cost + distance + ncost, index);
+			pathfind[Astar_Pathfind_Visited][key] = pathfind[Astar_Pathfind_Search_Nodes][ext];
+			if(other)
+				astar_pathfind_meet(pathfind, pathfind[Astar_Pathfind_Search_Nodes][ext], other);
+			// If we're looking for cheaper routes, completion waits until the path comes off the open list.  Otherwise, if
+			// the node we just reached is the target, add this path to the list of final paths and stop tracking path
+			// extensions; otherwise, add the extension to the open list, if extensions are being tracked.
+			if(pop_test) {
+				astar_open_push(pathfind, ext);
+			} else if(completion ? funcall(completion, pathfind) : targets ? member(targets, key) : (key == to_key)) {
+				final ||= ({});
+				final += ({ ext });
+			} else if(!final) {
+				astar_open_push(pathfind, ext);
+			}
+		}
+	}
+	// If we have any final paths, choose the best one as our result.
+	if(final) {
+		arena = pathfind[Astar_Pathfind_Search_Nodes];
+		int best = final[0];
+		foreach(int candidate : final)
+			if(astar_path_precedes(arena[candidate], arena[best]))
+				best = candidate;
+		pathfind[Astar_Pathfind_Active_Index] = best;
+		return Astar_Pass_Complete;
+	}
+	return pathfind[Astar_Pathfind_Path_Count] ? Astar_Pass_Continue : Astar_Pass_Exhausted;
+}
+
+// astar_pathfind_bidirectional_pass()
+//
+// Performs one pass of the pathfinder for a bidirectional pathfind,
+// returning one of the Astar_Pass_* outcomes, with Astar_Pass_Complete
+// meaning the best meeting in pathfind[Astar_Pathfind_Meeting] is the
+// result.  Each pass extends whichever search has the fewer paths on its
+// open list.  'to_key' and 'from_key' are the node keys of the target and
+// starting nodes.
+
+private int astar_pathfind_bidirectional_pass(mixed * pathfind, mixed to_key, mixed from_key, closure neighbors_source, closure batch_source) {
+	int forward_count = pathfind[Astar_Pathfind_Path_Count];
+	int backward_count = pathfind[Astar_Pathfind_Reverse_Path_Count];
+	mixed * meeting = pathfind[Astar_Pathfind_Meeting];
+	// Once the searches have met, we're done when one of them runs out of paths, or when neither has a path left
+	// cheaper than the meeting; so long as the distance rule never overestimates, the best cost on each open list
+	// is a lower bound on any path still to be found by way of it.
+	if(meeting) {
+		if(!forward_count || !backward_count)
+			return Astar_Pass_Complete;
+		float forward_bound = pathfind[Astar_Pathfind_Search_Nodes][pathfind[Astar_Pathfind_Paths][0]][Astar_Search_Node_Cost];
+		float backward_bound = pathfind[Astar_Pathfind_Reverse_Search_Nodes][pathfind[Astar_Pathfind_Reverse_Paths][0]][Astar_Search_Node_Cost];
+		if(meeting[Astar_Meeting_Cost] <= (forward_bound > backward_bound ? forward_bound : backward_bound))
+			return Astar_Pass_Complete;
+	} else if(!forward_count || !backward_count) {
+		return Astar_Pass_Exhausted;
+	}
+	int outcome;
+	if(backward_count < forward_count) {
+		// A neighbors rule specific to the pathfind is used in both directions.
+		closure reverse_source = !pathfind[Astar_Pathfind_Neighbors_Rule] && reverse_neighbors_rule;
+		astar_pathfind_reverse(pathfind);
+		outcome = astar_pathfind_pass(pathfind, from_key, reverse_source || neighbors_source, !reverse_source && batch_source);
+		astar_pathfind_reverse(pathfind);
+	} else {
+		outcome = astar_pathfind_pass(pathfind, to_key, neighbors_source, batch_source);
+	}
+	// A search running out of paths is dealt with on the next pass.
+	return outcome == Astar_Pass_Exhausted ? Astar_Pass_Continue : outcome;
+}
+
+// astar_pathfinder()
+//
+// Performs the actual work of path calculation; takes a fully
+// initialized (and maybe partially processed) pathfind data structure
+// as argument.  Can resume from any point in the pathfinding
+// process, which is what lets the algorithm suspend activity when
 // a run limit is reached and resume via the scheduling rule.
 
 private void astar_pathfinder(mixed * pathfind) {
@@ -514,107 +2681,60 @@ private void astar_pathfinder(mixed * pathfind) {
 	if(pathfind[Astar_Pathfind_Cycle_Index]) {
 		if(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Terminate)
 			return astar_pathfind_done(pathfind, Astar_Result_Terminated);
+		// An anytime pathfind out of time settles for the best path it has.
+		if(pathfind[Astar_Pathfind_Incumbent] && pathfind[Astar_Pathfind_Deadline] && time() >= pathfind[Astar_Pathfind_Deadline])
+			return astar_pathfind_close(pathfind, pathfind[Astar_Pathfind_Incumbent]);
 		if(!(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Uncache)) {
 			mixed path = astar_cached_path(pathfind);
 			if(path)
 				return astar_pathfind_done(pathfind, path[Astar_Cache_Path] || Astar_Result_Impossible);
 		}
 	}
-	pathfind[Astar_Pathfind_Cycle_Start] = utime();
-	pathfind[Astar_Pathfind_Cycle_Index]++;
-	pathfind[Astar_Pathfind_Cycle_Iterations] = 0;
-	mixed to_key = astar_key(pathfind[Astar_Pathfind_To]);
+	astar_cycle_begin(pathfind);
+	int bidirectional = pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Bidirectional;
+	mixed to_key = astar_key(pathfind, pathfind[Astar_Pathfind_To]);
+	mixed from_key = bidirectional && astar_key(pathfind, pathfind[Astar_Pathfind_From]);
+	// A neighbors rule specific to the pathfind takes the place of both of the instance's neighbors rules.
+	closure neighbors_source = pathfind[Astar_Pathfind_Neighbors_Rule] || neighbors_rule;
+	closure batch_source = !pathfind[Astar_Pathfind_Neighbors_Rule] && batch_neighbors_rule;
 	for(;;) {
 		pathfind[Astar_Pathfind_Cycle_Iterations]++;
-		if(run_limit_rule && funcall(run_limit_rule, pathfind)) {
-			if(pathfind[Astar_Pathfind_Callback] && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_No_Continue)) {
-				pathfind[Astar_Pathfind_Cycle_Index]++;
-				pathfind[Astar_Pathfind_Result] = Astar_Result_Processing;
-				funcall(scheduling_rule, #'astar_pathfinder, 2, pathfind);
-			} else {
-				pathfind[Astar_Pathfind_Result] = Astar_Result_Cut_Off;
+		if(astar_run_limit_reached(pathfind))
+			return astar_pathfind_suspend(pathfind, Astar_Result_Cut_Off);
+		int outcome;
+		if(bidirectional) {
+			outcome = astar_pathfind_bidirectional_pass(pathfind, to_key, from_key, neighbors_source, batch_source);
+			if(outcome == Astar_Pass_Complete) {
+				mixed * chain = astar_meeting_chain(pathfind);
+				return astar_pathfind_close(pathfind, astar_chain_path(chain), chain);
 			}
-			return;
-		}
-		mixed * extended = ({});
-		// Sort the paths on their cost; we only want to deal with the lowest-cost paths out of the ones we have.
-		mixed * paths = sort_array(pathfind[Astar_Pathfind_Paths], #'astar_path_sort);
-		// Get the cost of the best path on hand; we only want paths with this cost.
-		float cost = paths[<1][Astar_Path_Cost];
-		int ix;
-		mixed * final = 0;
-		// Check for possible extensions on as many paths as we have that are at our best cost.
-		for(ix = sizeof(paths) - 1; ix >= 0 && paths[ix][Astar_Path_Cost] <= cost; ix--) {
-			mixed * path = paths[ix];
-			pathfind[Astar_Pathfind_Active_Path] = path;
-			pathfind[Astar_Pathfind_Active_Node] = path[Astar_Path_Nodes][<1];
-			mixed * edges = path[Astar_Path_Edges];
-			pathfind[Astar_Pathfind_Active_Edge] = sizeof(edges) ? edges[<1] : 0;
-			// Retrieve the list of neighbor nodes and edges to reach them.
-			mixed neighbors = funcall(neighbors_rule, pathfind);
-			if(!pointerp(neighbors)) {
-				if(neighbors == Astar_Result_Processing) {
-					if(pathfind[Astar_Pathfind_Callback] && !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_No_Continue)) {
-						pathfind[Astar_Pathfind_Cycle_Index]++;
-						pathfind[Astar_Pathfind_Result] = Astar_Result_Processing;
-						funcall(scheduling_rule, #'astar_pathfinder, 2, pathfind);
-					} else {
-						pathfind[Astar_Pathfind_Result] = Astar_Result_Cannot_Continue;
-					}
-					return;
-				} else {
-					raise_error("Invalid return value from neighbors rule");
+		} else {
+			outcome = astar_pathfind_pass(pathfind, to_key, neighbors_source, batch_source);
+			if(outcome == Astar_Pass_Complete) {
+				int index = pathfind[Astar_Pathfind_Active_Index];
+				mixed * path = astar_search_path(pathfind, index);
+				// A pathfind for astar_find_paths() goes on to its next target, if it has one.
+				if(pathfind[Astar_Pathfind_Batch] && pathfind[Astar_Pathfind_Targets]) {
+					if(astar_batch_collect(pathfind, path, index))
+						continue;
+					return astar_pathfind_done(pathfind, path);
 				}
-			}
-			foreach(mixed * neighbor : neighbors) {
-				mixed node = neighbor[0];
-				mixed edge = neighbor[1];
-				mixed ncost = neighbor[2];
-				// If we've already been here, never mind.
-				mixed key = astar_key(node);
-				if(pathfind[Astar_Pathfind_Visited][key])
-					continue;
-				// Register node and edge in pathfind structure.
-				pathfind[Astar_Pathfind_Active_Node] = node;
-				pathfind[Astar_Pathfind_Active_Edge] = edge;
-				// If we have a validation rule for nodes, check against it.
-				if(pathfind[Astar_Pathfind_Validate] && !funcall(pathfind[Astar_Pathfind_Validate], pathfind))
-					continue;
-				// Okay, then, now we've been here.
-				pathfind[Astar_Pathfind_Visited][key] = 1;
-				// This is now a valid extension.  Assemble the extended path with this node added to it, and calculate the
-				// distance and cost.
-				mixed * active_path = pathfind[Astar_Pathfind_Active_Path];
-				mixed * ext_path = copy(active_path);
-				ext_path[Astar_Path_Nodes] += ({ node });
-				ext_path[Astar_Path_Edges] += ({ edge });
-				ext_path[Astar_Path_Distance] = astar_distance(pathfind);
-				// The cost of the extended path is its distance from the target node, plus the portion of the base path's cost
-				// that is not based on its distance, plus the cost of the edge.
-				ext_path[Astar_Path_Cost] = active_path[Astar_Path_Cost] - active_path[Astar_Path_Distance] + ext_path[Astar_Path_Distance] + ncost;
-				// If the node we just reached is the target, add this path to the list of final paths and stop tracking
-				// path extensions; otherwise, track path extension, if they are being tracked.
-				if(completion_rule ? funcall(completion_rule, pathfind) : (key == to_key)) {
-					final ||= ({});
-					final += ({ ext_path });
-					extended = 0;
-				} else if(extended) {
-					extended += ({ ext_path });
+				if(pathfind[Astar_Pathfind_Anytime_Step]) {
+					if(astar_pathfind_refine(pathfind, path))
+						return;
+					// The best path may have come from an earlier round, whose search nodes are gone.
+					if(pathfind[Astar_Pathfind_Incumbent] != path)
+						return astar_pathfind_close(pathfind, pathfind[Astar_Pathfind_Incumbent]);
 				}
+				return astar_pathfind_close(pathfind, path, node_index && astar_search_chain(pathfind, index));
 			}
 		}
-		// If we have any final paths, choose the best one as our result and finish.
-		if(final) {
-			if(sizeof(final) > 1)
-				final = sort_array(final, #'astar_path_sort);
-			return astar_pathfind_close(pathfind, final[0]);
-		}
-		// Get rid of the paths that we extended, and add the newly extended paths to our list.
-		paths = paths[0 .. ix] + extended;
-		// If we no longer have any paths to examine, we're out of luck.
-		if(!sizeof(paths))
-			return astar_pathfind_close(pathfind, Astar_Result_Impossible);
-		pathfind[Astar_Pathfind_Paths] = paths;
+		if(outcome == Astar_Pass_Suspend)
+			return astar_pathfind_suspend(pathfind, Astar_Result_Cannot_Continue);
+		// If we no longer have any paths to examine, we're out of luck, unless an earlier round of an anytime
+		// pathfind has found a path that nothing left could beat.
+		if(outcome == Astar_Pass_Exhausted)
+			return astar_pathfind_close(pathfind, pathfind[Astar_Pathfind_Incumbent] || Astar_Result_Impossible);
 		if(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Terminate)
 			return astar_pathfind_done(pathfind, Astar_Result_Terminated);
 	}
@@ -637,8 +2757,10 @@ private void astar_pathfinder(mixed * pathfind) {
 //     pathfind[Astar_Pathfind_Active_Edge]
 //         The edge to reach the active node from the previous node.
 //     pathfind[Astar_Pathfind_Active_Path]
-//         The entire path leading to the previous node; this is a path
+//         The entire path leading to the previous node, if the instance
+//         has declared Astar_Rule_Dependency_Active_Path; this is a path
 //         data structure as defined by the Astar_Path_* macros in astar.h.
+//         astar_active_path() will provide it in any case.
 //
 // The 'validate' function should return true if the node being examined
 // should be included in the path.
@@ -664,11 +2786,30 @@ private void astar_pathfinder(mixed * pathfind) {
 //
 // The fifth argument is an integer that may contain control flags, as defined
 // by the Astar_Pathfind_Control_Flag_* macros in astar.h.
+// Whatever the flags, the pathfind data structure keeps count of the work
+// done in its Astar_Pathfind_Stats_* fields: paths expanded, neighbors
+// generated, rejected and skipped, the peak size of the open list and cache
+// hits and misses.  With Astar_Pathfind_Control_Flag_Timing, it also keeps
+// the time spent in each rule, which tells you whether the neighbors rule
+// or the distance rule is the one worth a closer look.
 //
 // The sixth argument is an arbitrary user-supplied value.  It will be
 // passed to 'callback' after the path argument, and is accessible as
 // Astar_Pathfind_Extra in the pathfind data structure.
 //
+// The seventh and eighth arguments, 'priority' and 'deadline', matter under
+// central scheduling (see the notes on it above).  Pathfinds with a higher
+// priority are continued ahead of those with a lower one, so player-facing
+// requests can be given a higher priority than background wandering; the
+// default is 0.  'deadline' is the number of seconds within which the
+// pathfind should finish, and among pathfinds of the same priority, the
+// one whose deadline comes soonest goes first; pathfinds without one go
+// after those with one.  Neither stops a pathfind from running late.
+//
+// The ninth argument, 'weight', is the heuristic weight to use for this
+// pathfind, in place of the instance's; see the notes on the heuristic
+// weight above.
+//
 // The return value is the astar pathfind data structure (from astar.h) that
 // defines the pathfind request.  It can be manipulated (for example, by doing
 // pathfind[Astar_Pathfind_Control_Flags] |= Astar_Pathfind_Control_Flag_Terminate)
@@ -676,7 +2817,179 @@ private void astar_pathfinder(mixed * pathfind) {
 // is anything other than Astar_Result_Processing, the pathfind request has
 // completed.
 
-varargs mixed * astar_find_path(mixed from, mixed to, closure validate, closure callback, int control_flags, mixed extra) {
+varargs mixed * astar_find_path(mixed from, mixed to, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline, float weight) {
+	return astar_pathfind_start(astar_pathfind_create(from, to, validate, callback, control_flags, extra, priority, deadline, weight));
+}
+
+// astar_find_path_anytime()
+//
+// Performs pathfinding as astar_find_path() does, but in rounds, for when a
+// reasonable path soon is worth more than the best path later.  The first
+// round uses the heuristic weight 'weight' (Astar_Anytime_Default_Weight if
+// not given), which finds a path quickly; each round after that lowers the
+// weight by 'step' (Astar_Anytime_Default_Step if not given) and searches
+// again from the start, leaving out paths that can't come in under the
+// cost of the best path found so far, until a round has been done at a
+// weight of 1.0.  The callback is called with each better path as it is
+// found, with pathfind[Astar_Pathfind_Result] set to it, and then once
+// more at the end with the best path found, as usual.  The pathfind ends
+// early with its best path when 'deadline' passes or when
+// Astar_Pathfind_Control_Flag_Terminate is set.  Without a callback, or
+// with Astar_Pathfind_Control_Flag_No_Continue, only the first round is
+// done.  The rounds use Astar_Pathfind_Control_Flag_Decrease_Key, so if the
+// distance rule never overestimates, each path found costs at most the
+// weight of its round times as much as the cheapest, and the last is the
+// cheapest.  Anytime pathfinds can't be bidirectional.
+
+varargs mixed * astar_find_path_anytime(mixed from, mixed to, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline, float weight, float step) {
+	if(control_flags & Astar_Pathfind_Control_Flag_Bidirectional)
+		raise_error("Anytime pathfinding can't be bidirectional");
+	if(step < 0.0)
+		raise_error("Anytime step must be positive");
+	control_flags |= Astar_Pathfind_Control_Flag_Decrease_Key;
+	mixed * pathfind = astar_pathfind_create(from, to, validate, callback, control_flags, extra, priority, deadline, weight || Astar_Anytime_Default_Weight);
+	pathfind[Astar_Pathfind_Anytime_Step] = step || Astar_Anytime_Default_Step;
+	return astar_pathfind_start(pathfind);
+}
+
+// astar_find_path_any()
+//
+// Performs pathfinding starting with the 'from' node, searching for
+// whichever of the nodes in 'targets' is cheapest to reach, in a single
+// search rather than one for each.  The other arguments are as for
+// astar_find_path(), and the result is likewise, the path ending at the
+// target reached.  While the pathfind is under way,
+// pathfind[Astar_Pathfind_Targets] is a mapping of the node keys of the
+// targets to the targets, and pathfind[Astar_Pathfind_To] is the first of
+// the targets; the completion rule, if any, still decides completion,
+// and otherwise reaching any target completes the pathfind.  See the notes
+// on the targets distance rule for how distances are determined.
+//
+// So that the target found is the nearest rather than merely the first
+// stumbled upon, the pathfind uses Astar_Pathfind_Control_Flag_Decrease_Key
+// whatever 'control_flags' says; the path found is optimal as long as the
+// distance rule never overestimates.  These pathfinds are not cached, and
+// can't be bidirectional.
+
+varargs mixed * astar_find_path_any(mixed from, mixed * targets, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline) {
+	if(!sizeof(targets))
+		raise_error("No targets given for pathfind");
+	if(control_flags & Astar_Pathfind_Control_Flag_Bidirectional)
+		raise_error("Bidirectional pathfinding needs a single target");
+	control_flags |= Astar_Pathfind_Control_Flag_Decrease_Key | Astar_Pathfind_Control_Flag_Uncache;
+	mixed * pathfind = astar_pathfind_create(from, targets[0], validate, callback, control_flags, extra, priority, deadline);
+	mapping target_map = ([]);
+	foreach(mixed target : targets) {
+		if(node_rule)
+			target = funcall(node_rule, target);
+		target_map[astar_key(pathfind, target)] = target;
+	}
+	pathfind[Astar_Pathfind_Targets] = target_map;
+	return astar_pathfind_start(pathfind);
+}
+
+// astar_find_paths()
+//
+// Performs pathfinding for many queries at once, for when a number of
+// paths are wanted together, as when setting up patrol routes at reset.
+// 'pairs' is an array of ({ from, to }) queries; the other arguments are as
+// for astar_find_path() and apply to every query.  Queries from the same
+// starting node share a single search, which carries on past each target
+// it reaches until it has reached them all, as astar_find_path_any() would
+// for the nearest, so a starting node with many targets costs little more
+// than its farthest target does.  Where a starting node has only the one
+// target, its query is an ordinary astar_find_path() pathfind, and can be
+// bidirectional; searches for several targets can't be.
+//
+// The return value is the batch data structure (from astar.h) for the
+// queries, and 'callback', if given, is called with it once every query
+// has a result.  batch[Astar_Batch_Results] holds the results, in the
+// same order as 'pairs', in the form pathfind[Astar_Pathfind_Result] takes.
+// The cache is consulted for each query, and the paths found by the shared
+// searches are cached together when the batch completes.  The pathfinds of
+// the batch are in pathfind[Astar_Batch_Pathfinds], and can be terminated
+// individually as usual.  Without a callback, or with
+// Astar_Pathfind_Control_Flag_No_Continue, every search runs to its end or
+// its run limit before this returns, and queries not finished in that time
+// have Astar_Result_Cut_Off as their result.
+
+varargs mixed * astar_find_paths(mixed * pairs, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline) {
+	int count = sizeof(pairs);
+	mixed * batch = allocate(Astar_Batch_Fields);
+	batch[Astar_Batch_Queries] = pairs;
+	batch[Astar_Batch_Results] = allocate(count, Astar_Result_Processing);
+	batch[Astar_Batch_Pathfinds] = ({});
+	batch[Astar_Batch_Callback] = callback;
+	batch[Astar_Batch_Extra] = extra;
+	batch[Astar_Batch_Control_Flags] = control_flags;
+	batch[Astar_Batch_Cache_Entries] = ({});
+	// The batch's callback stands in for those of its pathfinds, which only report back to it.
+	closure group_callback = callback && #'astar_batch_group_done;
+	int flags = control_flags & ~Astar_Pathfind_Control_Flag_Silent;
+	// Sort the queries into groups by starting node, each with the pathfind data structure set up for its first query.
+	mapping groups = ([]);
+	for(int ix = 0; ix < count; ix++) {
+		mixed * pathfind = astar_pathfind_create(pairs[ix][0], pairs[ix][1], validate, group_callback, flags, extra, priority, deadline);
+		mixed from_key = astar_key(pathfind, pathfind[Astar_Pathfind_From]);
+		mixed to_key = astar_key(pathfind, pathfind[Astar_Pathfind_To]);
+		mixed * group = groups[from_key];
+		if(!group) {
+			group = groups[from_key] = pathfind;
+			group[Astar_Pathfind_Batch] = batch;
+			group[Astar_Pathfind_Batch_Queries] = ([]);
+			group[Astar_Pathfind_Targets] = ([]);
+		}
+		group[Astar_Pathfind_Targets][to_key] = pathfind[Astar_Pathfind_To];
+		group[Astar_Pathfind_Batch_Queries][to_key] = (group[Astar_Pathfind_Batch_Queries][to_key] || ({})) + ({ ix });
+	}
+	foreach(mixed from_key, mixed * pathfind : groups) {
+		mapping targets = pathfind[Astar_Pathfind_Targets];
+		mapping queries = pathfind[Astar_Pathfind_Batch_Queries];
+		// Targets the cache has paths to needn't be searched for.  A lone target is left for astar_pathfind_start()
+		// to look up.
+		if(sizeof(targets) > 1 && !(control_flags & Astar_Pathfind_Control_Flag_Uncache))
+			foreach(mixed to_key : m_indices(targets)) {
+				pathfind[Astar_Pathfind_To] = targets[to_key];
+				mixed entry = astar_cached_path(pathfind);
+				if(!entry)
+					continue;
+				foreach(int query : queries[to_key])
+					batch[Astar_Batch_Results][query] = entry[Astar_Cache_Path] || Astar_Result_Impossible;
+				map_delete(queries, to_key);
+				map_delete(targets, to_key);
+			}
+		if(!sizeof(targets))
+			continue;
+		pathfind[Astar_Pathfind_To] = m_values(targets)[0];
+		if(sizeof(targets) == 1)
+			pathfind[Astar_Pathfind_Targets] = 0;
+		else
+			pathfind[Astar_Pathfind_Control_Flags] = (flags & ~Astar_Pathfind_Control_Flag_Bidirectional) | Astar_Pathfind_Control_Flag_Decrease_Key | Astar_Pathfind_Control_Flag_Uncache;
+		batch[Astar_Batch_Pathfinds] += ({ pathfind });
+	}
+	batch[Astar_Batch_Pending] = sizeof(batch[Astar_Batch_Pathfinds]);
+	if(!batch[Astar_Batch_Pending]) {
+		astar_batch_finish(batch);
+		return batch;
+	}
+	foreach(mixed * pathfind : batch[Astar_Batch_Pathfinds]) {
+		astar_pathfind_start(pathfind);
+		// A pathfind that finished without going through its callback, for lack of one or of a way to continue
+		if(pathfind[Astar_Pathfind_Result] != Astar_Result_Processing)
+			astar_batch_group_done(pathfind);
+	}
+	return batch;
+}
+
+// astar_pathfind_create()
+//
+// Sets up the pathfind data structure for a pathfinding attempt, taking the
+// same arguments as astar_find_path(), without starting it.  Together with
+// astar_pathfind_start(), this lets modules building on this one adjust a
+// pathfind, e.g. by setting pathfind[Astar_Pathfind_Neighbors_Rule], before
+// it begins.
+
+protected varargs mixed * astar_pathfind_create(mixed from, mixed to, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline, float weight) {
 	// Constrain our representation of our 'from' and 'to' nodes
 	if(node_rule) {
 		from = funcall(node_rule, from);
@@ -684,6 +2997,8 @@ varargs mixed * astar_find_path(mixed from, mixed to, closure validate, closure
 	}
 	// Default scheduling rule to #'call_out if none has been set
 	scheduling_rule ||= #'call_out;
+	if(weight && weight < 1.0)
+		raise_error("Heuristic weight must be at least 1.0");
 	// Set up pathfinding data structure
 	mixed * pathfind = allocate(Astar_Pathfind_Fields);
 	pathfind[Astar_Pathfind_From] = from;
@@ -696,30 +3011,147 @@ varargs mixed * astar_find_path(mixed from, mixed to, closure validate, closure
 	pathfind[Astar_Pathfind_Active_Node] = from;
 	pathfind[Astar_Pathfind_Active_Edge] = 0;
 	pathfind[Astar_Pathfind_Control_Flags] = control_flags;
+	pathfind[Astar_Pathfind_Priority] = priority;
+	pathfind[Astar_Pathfind_Deadline] = deadline && time() + deadline;
+	pathfind[Astar_Pathfind_Heuristic_Weight] = weight || heuristic_weight;
+	return pathfind;
+}
+
+// astar_pathfind_start()
+//
+// Starts a pathfinding attempt set up by astar_pathfind_create(), returning
+// the pathfind data structure as astar_find_path() does.
+
+protected mixed * astar_pathfind_start(mixed * pathfind) {
+	// On a graph needing a reverse neighbors rule, the distance rule can't guide the backward search; see the notes on it.
+	if((pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Bidirectional) && reverse_neighbors_rule && !pathfind[Astar_Pathfind_Neighbors_Rule] && distance_rule && !reverse_distance_rule)
+		raise_error("Bidirectional pathfinding with a reverse neighbors rule needs a reverse distance rule");
 	// Check for a cached path
-	mixed path = astar_cached_path(pathfind);
+	mixed path = !(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Uncache) && astar_cached_path(pathfind);
 	if(path) {
 		pathfind[Astar_Pathfind_Result] = path[Astar_Cache_Path] || Astar_Result_Impossible;
-		if(callback)
-			funcall(callback, pathfind);
+		astar_pathfind_report(pathfind);
+		if(pathfind[Astar_Pathfind_Callback])
+			funcall(pathfind[Astar_Pathfind_Callback], pathfind);
 		return pathfind;
 	}
-	// Set up our starting point based on the 'from' node
-	mixed * start = allocate(Astar_Path_Fields);
-	pathfind[Astar_Pathfind_Active_Path] = start;
-	start[Astar_Path_Nodes] = ({ from });
-	start[Astar_Path_Edges] = ({});
-	start[Astar_Path_Distance] = astar_distance(pathfind);
-	start[Astar_Path_Cost] = start[Astar_Path_Distance];
-	// Starting point becomes our path list, mapping to track where we've visited starts out populated with starting node
-	pathfind[Astar_Pathfind_Paths] = ({ start });
-	pathfind[Astar_Pathfind_Visited] = ([
-		astar_key(from) : 1,
-	]);
+	// Leave the searching to a matching pathfind already under way, if there is one
+	if(astar_coalesce_join(pathfind))
+		return pathfind;
+	astar_pathfind_seed(pathfind);
+	// A bidirectional pathfind gets the same setup for its backward search, from the 'to' node.  If the two
+	// searches start out at the same node, they have already met.
+	if(pathfind[Astar_Pathfind_Control_Flags] & Astar_Pathfind_Control_Flag_Bidirectional) {
+		astar_pathfind_reverse(pathfind);
+		astar_pathfind_seed(pathfind);
+		astar_pathfind_reverse(pathfind);
+		mixed * backward = pathfind[Astar_Pathfind_Reverse_Search_Nodes][0];
+		mixed * forward = pathfind[Astar_Pathfind_Visited][backward[Astar_Search_Node_Key]];
+		if(forward)
+			astar_pathfind_meet(pathfind, forward, backward);
+	}
 	astar_pathfinder(pathfind);
 	return pathfind;
 }
 
+// astar_active_path()
+//
+// Returns the path data structure for the path a pathfind is currently
+// working with, i.e. the path leading to pathfind[Astar_Pathfind_Active_Node]
+// for the neighbors rule, or to the node before it for 'validate' and the
+// distance and completion rules.  This is intended for use by rules that
+// only occasionally need to look at the path, so that the instance doesn't
+// need to declare Astar_Rule_Dependency_Active_Path; the path is assembled
+// each time this is called.
+
+mixed * astar_active_path(mixed * pathfind) {
+	return pathfind[Astar_Pathfind_Active_Path] || astar_search_path(pathfind, pathfind[Astar_Pathfind_Active_Index]);
+}
+
+// astar_trace()
+//
+// Returns the trace records kept for a pathfind run with
+// Astar_Pathfind_Control_Flag_Trace, oldest first, as Astar_Trace_*
+// structures from astar.h.  If pathfind[Astar_Pathfind_Trace_Count] is
+// larger than the number returned, the earliest records were dropped to
+// stay within the trace limit.
+
+mixed * astar_trace(mixed * pathfind) {
+	mixed * trace = pathfind[Astar_Pathfind_Trace];
+	if(!trace)
+		return ({});
+	int count = pathfind[Astar_Pathfind_Trace_Count];
+	int size = sizeof(trace);
+	if(count <= size)
+		return trace[0 .. count - 1];
+	int start = count % size;
+	return trace[start ..] + trace[0 .. start - 1];
+}
+
+// astar_trace_render()
+//
+// Draws the region a traced pathfind expanded, for pathfinds in a 2D grid
+// like the one in examples/astar_2d.c, as a string of lines, one per row,
+// with smaller y coordinates first.  Cells whose nodes were expanded are
+// shown as 'o', or 'O' if expanded more than once, nodes on the path
+// found as '*', the starting and target nodes as 'S' and 'T', and other
+// cells as '.'.  A closing line gives the number of expansions, the path
+// length in nodes and the ratio between them, which is near 1 when the
+// distance rule leads the search straight to the target and grows as the
+// search wanders.  'coordinates' is called with a node key to get the
+// ({ x, y }) coordinates of the node it stands for; if it isn't given, the
+// keys should be the coordinates.  Only the expansions still in the trace
+// are drawn.
+
+varargs string astar_trace_render(mixed * pathfind, closure coordinates) {
+	// Expansion counts and marks, as mappings of x coordinates to mappings of y coordinates to values
+	mapping expanded = ([]);
+	mapping marks = ([]);
+	int * bounds = 0;
+	foreach(mixed * record : astar_trace(pathfind))
+		if(record[Astar_Trace_Event] == Astar_Trace_Event_Expand || record[Astar_Trace_Event] == Astar_Trace_Event_Expand_Backward) {
+			int * cell = coordinates ? funcall(coordinates, record[Astar_Trace_Key]) : record[Astar_Trace_Key];
+			mapping column = expanded[cell[0]] ||= ([]);
+			column[cell[1]]++;
+			bounds = bounds ? ({ min(bounds[0], cell[0]), min(bounds[1], cell[1]), max(bounds[2], cell[0]), max(bounds[3], cell[1]) }) : ({ cell[0], cell[1], cell[0], cell[1] });
+		}
+	mixed result = pathfind[Astar_Pathfind_Result];
+	mixed * nodes = pointerp(result) ? result[Astar_Path_Nodes] : ({});
+	mixed * marked = nodes + ({ pathfind[Astar_Pathfind_From], pathfind[Astar_Pathfind_To] });
+	int * symbols = allocate(sizeof(nodes), '*') + ({ 'S', 'T' });
+	for(int ix = 0; ix < sizeof(marked); ix++) {
+		mixed key = astar_key(pathfind, marked[ix]);
+		int * cell = coordinates ? funcall(coordinates, key) : key;
+		mapping column = marks[cell[0]] ||= ([]);
+		column[cell[1]] = symbols[ix];
+		bounds = bounds ? ({ min(bounds[0], cell[0]), min(bounds[1], cell[1]), max(bounds[2], cell[0]), max(bounds[3], cell[1]) }) : ({ cell[0], cell[1], cell[0], cell[1] });
+	}
+	string out = "";
+	for(int y = bounds[1]; y <= bounds[3]; y++) {
+		string row = " " * (bounds[2] - bounds[0] + 1);
+		for(int x = bounds[0]; x <= bounds[2]; x++) {
+			int count = expanded[x] && expanded[x][y];
+			row[x - bounds[0]] = (marks[x] && marks[x][y]) || (count > 1 ? 'O' : count ? 'o' : '.');
+		}
+		out += row + "\n";
+	}
+	int expansions = pathfind[Astar_Pathfind_Stats_Expanded];
+	out += expansions + " expanded, path of " + sizeof(nodes) + " nodes";
+	if(sizeof(nodes))
+		out += sprintf(", %.2f expanded per path node", to_float(expansions) / sizeof(nodes));
+	return out + "\n";
+}
+
+// astar_node_key()
+//
+// Returns the node key the module uses for 'node', by way of the node key
+// rule or the bounded space, as the case may be.  Modules building on this
+// one use it to key nodes the same way.
+
+protected mixed astar_node_key(mixed node) {
+	return astar_key(0, node);
+}
+
 // astar_clear_cache()
 //
 // Clears out the contents of the cache.  This can be useful for allowing
@@ -727,12 +3159,107 @@ varargs mixed * astar_find_path(mixed from, mixed to, closure validate, closure
 // some sort of dynamicism in them (changing exits, shifting graph
 // connectivity, etc.) would invalidate cached paths.  Using this, you can
 // call astar_clear_cache() when changes occur, so that no outdated paths
-// will be returned.
+// will be returned.  The neighbor cache is cleared as well, if it is in
+// use.
 
 void astar_clear_cache() {
-	if(!cache)
+	if(!cache && !neighbor_cache_limit)
 		raise_error("astar_clear_cache() called with caching off");
+	if(neighbor_cache_limit)
+		set_astar_neighbor_caching(neighbor_cache_limit);
+	if(!cache)
+		return;
 	cache = ([]);
+	cache_expiry = ([]);
+	if(node_index)
+		node_index = ([]);
+	if(cache_impossible)
+		cache_impossible = ([]);
+	cache_entries = 0;
+	cache_bytes = 0;
+}
+
+// astar_invalidate_node()
+//
+// Drops the cache entries whose paths pass through 'node', for use when
+// something about the node has changed such that paths through it may no
+// longer be valid.  Entries recording that no path could be found are
+// dropped as well, since the change may have opened up a way.  Requires
+// targeted invalidation to be on, unless only neighbor caching is in use;
+// see the notes on them above.  Cached neighbor lists for the node, and
+// those of its neighbors that would lead back to it, are dropped too; with
+// no reverse neighbors rule, the graph is taken to be symmetric, and the
+// lists in both directions are dropped for every neighbor on the node's.
+
+void astar_invalidate_node(mixed node) {
+	if(!targeted_invalidation && !neighbor_cache_limit)
+		raise_error("astar_invalidate_node() called with targeted invalidation off");
+	if(node_rule)
+		node = funcall(node_rule, node);
+	mixed key = astar_key(0, node);
+	if(neighbor_cache_limit)
+		for(int direction = 0; direction < 2; direction++) {
+			mixed * list = astar_neighbors_forget(direction, key);
+			if(list)
+				foreach(mixed * neighbor : list) {
+					mixed neighbor_key = astar_key(0, neighbor[0]);
+					astar_neighbors_forget(!direction, neighbor_key);
+					if(!reverse_neighbors_rule)
+						astar_neighbors_forget(direction, neighbor_key);
+				}
+		}
+	if(!targeted_invalidation)
+		return;
+	foreach(mixed validate_key : m_indices(node_index)) {
+		mapping positions = node_index[validate_key] && node_index[validate_key][key];
+		if(positions)
+			foreach(mixed * entry : m_indices(positions))
+				astar_cache_remove(entry);
+	}
+	foreach(mixed * entry : m_indices(cache_impossible))
+		astar_cache_remove(entry);
+}
+
+// astar_invalidate_edge()
+//
+// Drops the cache entries whose paths follow 'edge' from 'from', for use
+// when the edge has changed or gone away, along with the entries recording
+// that no path could be found, as astar_invalidate_node() does.  Edges are
+// compared by value, so array edges like ({ 0, 1 }) work as expected.
+// Requires targeted invalidation to be on, unless only neighbor caching is
+// in use.  The cached neighbor list for 'from' is dropped too, along with
+// the backward one for the node the edge led to, if it can be told.
+
+void astar_invalidate_edge(mixed from, mixed edge) {
+	if(!targeted_invalidation && !neighbor_cache_limit)
+		raise_error("astar_invalidate_edge() called with targeted invalidation off");
+	if(node_rule)
+		from = funcall(node_rule, from);
+	mixed key = astar_key(0, from);
+	if(neighbor_cache_limit) {
+		mixed * list = astar_neighbors_forget(0, key);
+		if(list)
+			foreach(mixed * neighbor : list)
+				if(astar_edge_matches(neighbor[1], edge))
+					astar_neighbors_forget(1, astar_key(0, neighbor[0]));
+	}
+	if(!targeted_invalidation)
+		return;
+	foreach(mixed validate_key : m_indices(node_index)) {
+		mapping positions = node_index[validate_key] && node_index[validate_key][key];
+		if(!positions)
+			continue;
+		mixed * affected = ({});
+		foreach(mixed * entry, int position : positions) {
+			mixed * edges = entry[Astar_Cache_Path][Astar_Path_Edges];
+			if(position < sizeof(edges) && astar_edge_matches(edges[position], edge))
+				affected += ({ entry });
+		}
+		foreach(mixed * entry : affected)
+			astar_cache_remove(entry);
+	}
+	foreach(mixed * entry : m_indices(cache_impossible))
+		astar_cache_remove(entry);
 }
 
 // astar_prune_cache()
@@ -744,23 +3271,187 @@ void astar_clear_cache() {
 // 'threshold' defaults to Astar_Prune_Cache_Default_Threshold, 7200.
 // The tuning factor is Astar_Prune_Cache_Hit_Factor, 60.
 //
+// Entries are found by way of an index of their expiry times, so only the
+// entries actually being dropped, and a few near them, are looked at.
+// If 'slice' is given, at most that many entries are dropped per call, and
+// if more remain to be dropped, pruning continues via the scheduling rule,
+// which is passed an array of the arguments to continue with in place of a
+// pathfind data structure.  This keeps a large prune from hitting the eval
+// limit or stalling the game.
+//
 // It is generally appropriate to call this function from reset() of an
 // object that inherits this module and uses caching.
 
-varargs void astar_prune_cache(int threshold) {
+varargs void astar_prune_cache(int threshold, int slice) {
 	if(!cache)
 		raise_error("astar_prune_cache() called with caching off");
 	threshold ||= Astar_Prune_Cache_Default_Threshold;
 	int cutoff = time() - threshold;
-	foreach(string validate_key, mapping validate_cache : cache) {
-		foreach(string from_key, mapping from_cache : validate_cache) {
-			foreach(string to_key, mixed entry : from_cache)
-				if(entry[Astar_Cache_Timestamp] + (entry[Astar_Cache_Hits] * Astar_Prune_Cache_Hit_Factor) < cutoff)
-					map_delete(from_cache, to_key);
-			if(!sizeof(from_cache))
-				map_delete(validate_cache, from_key);
+	int removed = 0;
+	foreach(int bucket : sort_array(m_indices(cache_expiry), #'>)) {
+		// Buckets beginning at or after the cutoff don't hold anything expired.
+		if(bucket * Astar_Prune_Cache_Bucket_Size >= cutoff)
+			break;
+		foreach(mixed * entry : m_indices(cache_expiry[bucket])) {
+			if(astar_cache_expiry(entry) >= cutoff)
+				continue;
+			if(slice && removed >= slice)
+				return funcall(scheduling_rule || #'call_out, #'astar_prune_cache_continue, 2, ({ threshold, slice }));
+			astar_cache_remove(entry);
+			removed++;
+		}
+	}
+}
+
+// astar_prune_cache_continue()
+//
+// Continues a prune started by astar_prune_cache() with a slice size, via
+// the scheduling rule.
+
+private void astar_prune_cache_continue(mixed * prune) {
+	if(cache)
+		astar_prune_cache(prune[0], prune[1]);
+}
+
+// astar_snapshot_line()
+//
+// Returns the save_value() encoding of 'value' as a line of a cache
+// snapshot, without the format line, which the snapshot holds only once.
+
+private string astar_snapshot_line(mixed value) {
+	string encoded = save_value(value);
+	return encoded[member(encoded, '\n') + 1 ..];
+}
+
+// astar_save_cache()
+//
+// Writes the contents of the cache to 'file', replacing it if it exists,
+// for astar_restore_cache() to read back in, e.g. after a reboot.  Entries
+// keep their hit counts and timestamps, along with the indexing subpath
+// caching uses, and paths stored in compact form are written that way.
+// Returns the number of entries written.  Each entry takes a line of its
+// own, so the snapshot can be read back in pieces within the driver's
+// limit on read_file(); an entry too long to read on its own is lost.
+
+int astar_save_cache(string file) {
+	if(!cache)
+		raise_error("astar_save_cache() called with caching off");
+	mixed * snapshot = allocate(Astar_Cache_Snapshot_Fields);
+	snapshot[Astar_Cache_Snapshot_Format] = Astar_Cache_Snapshot_Current_Format;
+	snapshot[Astar_Cache_Snapshot_Version] = cache_version;
+	snapshot[Astar_Cache_Snapshot_Timestamp] = time();
+	snapshot[Astar_Cache_Snapshot_Entries] = cache_entries;
+	string encoded = save_value(snapshot);
+	if(file_size(file) >= 0)
+		rm(file);
+	// The format line and header, then the entries, written a slice at a time.
+	string chunk = encoded;
+	int count = 0;
+	foreach(mixed validate_key, mapping validate_cache : cache)
+		foreach(mixed from_key, mapping from_cache : validate_cache)
+			foreach(mixed to_key, mixed * entry : from_cache) {
+				mixed * saved = copy(entry);
+				saved[Astar_Cache_Expiry_Bucket] = 0;
+				saved[Astar_Cache_Size] = 0;
+				chunk += astar_snapshot_line(saved);
+				if(!(++count % Astar_Cache_Restore_Default_Slice)) {
+					if(!write_file(file, chunk))
+						raise_error("Unable to write cache snapshot to " + file);
+					chunk = "";
+				}
+			}
+	if(chunk != "" && !write_file(file, chunk))
+		raise_error("Unable to write cache snapshot to " + file);
+	return count;
+}
+
+// astar_restore_cache()
+//
+// Reads a snapshot written by astar_save_cache() from 'file' and adds its
+// entries to the cache.  The snapshot is rejected if it is missing, in
+// another format, or from an instance with a different cache version (see
+// the notes on it above).  Entries are added at most 'slice' at a time,
+// Astar_Cache_Restore_Default_Slice if not given, with the rest continued
+// via the scheduling rule as astar_prune_cache() does, so that a large
+// snapshot doesn't hold up boot; paths found in the meantime take
+// precedence over those from the snapshot.  Entries are read from the file
+// and decoded as they are restored, so that only the header is read here.
+// Entries that rely on compact caching are dropped if it is no longer on
+// and there is no apply edge rule to rebuild their paths with.  Returns the
+// number of entries the snapshot holds, or 0 if it was rejected; raises an
+// error if the header can't be read from a file that isn't empty.
+
+varargs int astar_restore_cache(string file, int slice) {
+	if(!cache)
+		raise_error("astar_restore_cache() called with caching off");
+	if(file_size(file) <= 0)
+		return 0;
+	string format = read_file(file, 1, 1);
+	string header = read_file(file, 2, 1);
+	if(!format || !header)
+		raise_error("Unable to read cache snapshot header from " + file);
+	mixed snapshot = 0;
+	catch(snapshot = restore_value(format + header));
+	if(!pointerp(snapshot) || sizeof(snapshot) != Astar_Cache_Snapshot_Fields)
+		return 0;
+	if(snapshot[Astar_Cache_Snapshot_Format] != Astar_Cache_Snapshot_Current_Format)
+		return 0;
+	// Compared with save_value() so that array and mapping versions match by value.
+	if(save_value(snapshot[Astar_Cache_Snapshot_Version]) != save_value(cache_version))
+		return 0;
+	int entries = snapshot[Astar_Cache_Snapshot_Entries];
+	// The file, its format line, the line of the next entry, the number of entries left, the slice size and the
+	// cache version
+	astar_restore_cache_continue(({ file, format, 3, entries, slice || Astar_Cache_Restore_Default_Slice, cache_version }));
+	return entries;
+}
+
+// astar_restore_cache_continue()
+//
+// Reads and adds the next slice of entries from a snapshot being restored
+// by astar_restore_cache(), continuing via the scheduling rule if entries
+// remain.  A slice too long for read_file() is read in smaller pieces, down
+// to single entries; an entry too long to be read alone is skipped.  A
+// restore is abandoned if caching is turned off, the cache version changes
+// or the file goes away while it is under way.
+
+private void astar_restore_cache_continue(mixed * restore) {
+	if(!cache || restore[3] <= 0 || save_value(restore[5]) != save_value(cache_version))
+		return;
+	int lines = min(restore[3], restore[4]);
+	string chunk = 0;
+	while(lines && !(chunk = read_file(restore[0], restore[2], lines)))
+		lines /= 2;
+	if(!chunk) {
+		if(file_size(restore[0]) <= 0)
+			return;
+		lines = 1;
+	}
+	restore[2] += lines;
+	restore[3] -= lines;
+	foreach(string line : chunk ? explode(chunk, "\n")[0 .. lines - 1] : ({})) {
+		mixed entry = 0;
+		catch(entry = restore_value(restore[1] + line + "\n"));
+		if(!pointerp(entry) || sizeof(entry) != Astar_Cache_Fields)
+			continue;
+		mapping validate_cache = cache[entry[Astar_Cache_Validate_Key]];
+		mapping from_cache = validate_cache && validate_cache[entry[Astar_Cache_From_Key]];
+		if(from_cache && from_cache[entry[Astar_Cache_To_Key]])
+			continue;
+		// A compact path is rebuilt if the cache no longer stores paths compactly, or needs its nodes for indexing.
+		if(entry[Astar_Cache_Compact] && (!compact_caching || (node_index && !entry[Astar_Cache_Keys]))) {
+			if(!apply_edge_rule)
+				continue;
+			entry[Astar_Cache_Path] = astar_cache_entry_path(entry);
+			entry[Astar_Cache_Compact] = 0;
+		}
+		// Without the node index, the entry's keys and costs would only take up space.
+		if(!node_index) {
+			entry[Astar_Cache_Keys] = 0;
+			entry[Astar_Cache_Costs] = 0;
 		}
-		if(!sizeof(validate_cache))
-			map_delete(cache, validate_key);
+		astar_cache_store(0, entry, 0);
 	}
+	if(restore[3] > 0)
+		funcall(scheduling_rule || #'call_out, #'astar_restore_cache_continue, 2, restore);
 }
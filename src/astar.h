@@ -24,6 +24,37 @@
 
 #define Astar_Path_Fields                       4
 
+// A* Search Node Data Structure
+//
+// Tracks one step of a path under consideration, internally to the
+// pathfinder.  Rather than each path under consideration carrying a full
+// copy of its nodes and edges, the pathfinder keeps search nodes in an arena
+// (pathfind[Astar_Pathfind_Search_Nodes]), each pointing back to the search
+// node it extends by arena index.  Full Astar_Path_* structures are only
+// assembled from these for results and for rules that ask for them.
+//
+// The distance and cost fields share their positions with the corresponding
+// Astar_Path_* fields, so the same comparison functions work on both.
+
+// The node reached
+#define Astar_Search_Node_Node                  0
+// The edge used to reach the node from the parent search node's node, or 0 at the beginning of a path
+#define Astar_Search_Node_Edge                  1
+// The node's distance from its target
+#define Astar_Search_Node_Distance              2
+// The accumulated cost of the path up to this node, as with Astar_Path_Cost
+#define Astar_Search_Node_Cost                  3
+// The arena index of the search node this one extends, or -1 at the beginning of a path
+#define Astar_Search_Node_Parent                4
+// The node key of the node reached
+#define Astar_Search_Node_Key                   5
+// The search node's position in the open list heap, or -1 if it is not on the open list
+#define Astar_Search_Node_Heap_Index            6
+// The search node's arena index, giving the order search nodes were made in, for tie-breaking
+#define Astar_Search_Node_Sequence              7
+
+#define Astar_Search_Node_Fields                8
+
 // A* Cache Data Structure
 //
 // Tracks a path cache entry.
@@ -34,8 +65,41 @@
 #define Astar_Cache_Hits                        1
 // The timestamp of the most recent time the cache entry was requested.
 #define Astar_Cache_Timestamp                   2
+// The validate key the cache entry is stored under.
+#define Astar_Cache_Validate_Key                3
+// The node key of the path's starting node.
+#define Astar_Cache_From_Key                    4
+// The node key of the path's target node.
+#define Astar_Cache_To_Key                      5
+// The node keys of the nodes in the path, if the entry is indexed for subpath caching.
+#define Astar_Cache_Keys                        6
+// The accumulated cost of the path up to each of its nodes, if the entry is indexed for subpath caching.
+#define Astar_Cache_Costs                       7
+// The bucket of the cache's expiry index the entry is filed in
+#define Astar_Cache_Expiry_Bucket               8
+// The approximate memory used by the entry, in bytes
+#define Astar_Cache_Size                        9
+// True if the entry's path is stored in compact form, with only the first of its nodes; see set_astar_compact_caching()
+#define Astar_Cache_Compact                     10
 
-#define Astar_Cache_Fields                      3
+#define Astar_Cache_Fields                      11
+
+// A* Cache Snapshot Data Structure
+//
+// The header of a file written by astar_save_cache().  The file holds the format line of save_value()'s encoding,
+// then this structure and each of the cache entries, one per line, each as encoded by save_value() without the format
+// line, so that it can be read back a few lines at a time.
+
+// The snapshot format, Astar_Cache_Snapshot_Current_Format when it was written
+#define Astar_Cache_Snapshot_Format             0
+// The cache version (see set_astar_cache_version()) of the instance that wrote it
+#define Astar_Cache_Snapshot_Version            1
+// The time() it was written at
+#define Astar_Cache_Snapshot_Timestamp          2
+// The number of cache entries following, as Astar_Cache_* structures without their expiry buckets and sizes
+#define Astar_Cache_Snapshot_Entries            3
+
+#define Astar_Cache_Snapshot_Fields             4
 
 // A* Pathfind Data Structure
 //
@@ -56,13 +120,16 @@
 #define Astar_Pathfind_Callback                 3
 // The 'extra' argument astar_find_path() was called with, if any
 #define Astar_Pathfind_Extra                    4
-// A mapping of the nodes visited
+// A mapping of the nodes visited, from node key to the search node (Astar_Search_Node_* structure) reaching it; in a
+// bounded space (see set_astar_bounded_space()), an array indexed by node key instead, 0 for nodes not visited
 #define Astar_Pathfind_Visited                  5
 // The utime() when the pathfinding attempt started
 #define Astar_Pathfind_Start_Time               6
-// An array of the working path list for the pathfinding attempt
+// The open list for the pathfinding attempt: Astar_Pathfind_Search_Nodes indices, kept as a binary min-heap on
+// Astar_Search_Node_Cost; only the first Astar_Pathfind_Path_Count elements are in use
 #define Astar_Pathfind_Paths                    7
-// Set to the current path being worked with
+// Set to the current path being worked with, if the instance declares Astar_Rule_Dependency_Active_Path; otherwise 0
+// (rules can call astar_active_path() to get it)
 #define Astar_Pathfind_Active_Path              8
 // The utime() when the current pathfinding cycle, initial or call_out(), began
 #define Astar_Pathfind_Cycle_Start              9
@@ -78,8 +145,438 @@
 #define Astar_Pathfind_Result                   14
 // Bitmask field that can contain Astar_Pathfind_Control_Flags as described below
 #define Astar_Pathfind_Control_Flags            15
+// The number of paths currently held in the Astar_Pathfind_Paths heap
+#define Astar_Pathfind_Path_Count               16
+// The search node arena (Astar_Search_Node_* structures); only the first Astar_Pathfind_Search_Node_Count are in use
+#define Astar_Pathfind_Search_Nodes             17
+// The number of search nodes currently held in the Astar_Pathfind_Search_Nodes arena
+#define Astar_Pathfind_Search_Node_Count        18
+// Set to the arena index of the search node for the current path being worked with
+#define Astar_Pathfind_Active_Index             19
+// Set to the nodes being worked with, for the batch neighbors rule
+#define Astar_Pathfind_Active_Nodes             20
+// Set to the edges reaching the nodes being worked with, for the batch neighbors rule
+#define Astar_Pathfind_Active_Edges             21
+// If set, a neighbors rule used for this pathfind in place of the instance's neighbors and batch neighbors rules
+#define Astar_Pathfind_Neighbors_Rule           22
+// If set, a closure called with the pathfind and a successful result path, returning the path to use as the result
+#define Astar_Pathfind_Result_Rule              23
+// Set to 1 while the backward search of a bidirectional pathfind is being worked with, during which the values of
+// Astar_Pathfind_From and Astar_Pathfind_To are exchanged, as are the forward search's open list, search node arena
+// and visited mapping with the backward search's, held in the Astar_Pathfind_Reverse_* fields; otherwise 0
+#define Astar_Pathfind_Direction                24
+// For a bidirectional pathfind, the visited mapping of the search not being worked with; otherwise 0
+#define Astar_Pathfind_Reverse_Visited          25
+// For a bidirectional pathfind, the open list of the search not being worked with
+#define Astar_Pathfind_Reverse_Paths            26
+// For a bidirectional pathfind, the number of paths held in Astar_Pathfind_Reverse_Paths
+#define Astar_Pathfind_Reverse_Path_Count       27
+// For a bidirectional pathfind, the search node arena of the search not being worked with
+#define Astar_Pathfind_Reverse_Search_Nodes     28
+// For a bidirectional pathfind, the number of search nodes held in Astar_Pathfind_Reverse_Search_Nodes
+#define Astar_Pathfind_Reverse_Search_Node_Count 29
+// For a bidirectional pathfind, the best meeting of the two searches found so far (an Astar_Meeting_* structure), if any
+#define Astar_Pathfind_Meeting                  30
+// The number of paths whose neighbors have been retrieved
+#define Astar_Pathfind_Stats_Expanded           31
+// The number of neighbors returned by the neighbors rule (or batch neighbors rule)
+#define Astar_Pathfind_Stats_Generated          32
+// The number of neighbors rejected by the 'validate' closure
+#define Astar_Pathfind_Stats_Rejected           33
+// The number of neighbors skipped because their nodes had already been reached as cheaply
+#define Astar_Pathfind_Stats_Duplicates         34
+// The largest number of paths held on the open list (both open lists, for a bidirectional pathfind) at once
+#define Astar_Pathfind_Stats_Peak_Open          35
+// The number of cache lookups that have found a path or a record of impossibility
+#define Astar_Pathfind_Stats_Cache_Hits         36
+// The number of cache lookups that have found nothing
+#define Astar_Pathfind_Stats_Cache_Misses       37
+// The microseconds spent in the neighbors rule (or batch or reverse neighbors rule), if Astar_Pathfind_Control_Flag_Timing is used
+#define Astar_Pathfind_Stats_Neighbors_Time     38
+// The microseconds spent in the distance rule, if Astar_Pathfind_Control_Flag_Timing is used
+#define Astar_Pathfind_Stats_Distance_Time      39
+// The microseconds spent in the 'validate' closure, if Astar_Pathfind_Control_Flag_Timing is used
+#define Astar_Pathfind_Stats_Validate_Time      40
+// The microseconds spent in the node key rule, if Astar_Pathfind_Control_Flag_Timing is used
+#define Astar_Pathfind_Stats_Node_Key_Time      41
+// The priority given to astar_find_path(); under central scheduling, higher priorities are continued first
+#define Astar_Pathfind_Priority                 42
+// The time() by which the pathfind should finish, from the deadline given to astar_find_path(), or 0 for none; under
+// central scheduling, pathfinds of the same priority are continued earliest deadline first
+#define Astar_Pathfind_Deadline                 43
+// The get_eval_cost() value at the start of the current processing cycle, for the adaptive run limit
+#define Astar_Pathfind_Cycle_Eval_Start         44
+// The value of Astar_Pathfind_Cycle_Iterations at which the adaptive run limit is next checked
+#define Astar_Pathfind_Cycle_Next_Check         45
+// The ({ validate key, from key, to key }) the pathfind is listed under for request coalescing, while it is
+#define Astar_Pathfind_Coalesce_Key             46
+// The pathfind data structures of the requests joined to this one by request coalescing, to be given its result
+#define Astar_Pathfind_Followers                47
+// For a pathfind with several targets (astar_find_path_any()), a mapping of the node keys of the targets to the targets
+#define Astar_Pathfind_Targets                  48
+// The weight the distance rule's estimates are multiplied by
+#define Astar_Pathfind_Heuristic_Weight         49
+// For an anytime pathfind (astar_find_path_anytime()), how much the heuristic weight is lowered by each round
+#define Astar_Pathfind_Anytime_Step             50
+// For an anytime pathfind, the best path found so far
+#define Astar_Pathfind_Incumbent                51
+// For an anytime pathfind, the cost of the best path found so far; paths that can't beat it are left out
+#define Astar_Pathfind_Upper_Bound              52
+// For a pathfind done by the grid module, astar_grid.c, the grid description (see the Astar_Grid_* macros) in use
+#define Astar_Pathfind_Grid                     53
+// For a pathfind done for astar_find_paths(), the batch data structure (see the Astar_Batch_* macros) it is part of
+#define Astar_Pathfind_Batch                    54
+// For a pathfind done for astar_find_paths(), a mapping of the node keys of its targets to the positions in
+// Astar_Batch_Queries of the queries still waiting on them, or 0 once it has given the batch its results
+#define Astar_Pathfind_Batch_Queries            55
+// With Astar_Pathfind_Control_Flag_Trace, the trace records (see the Astar_Trace_* macros) kept, as a ring buffer;
+// astar_trace() gives them in order
+#define Astar_Pathfind_Trace                    56
+// With Astar_Pathfind_Control_Flag_Trace, the number of trace records made, including those no longer kept
+#define Astar_Pathfind_Trace_Count              57
+// For a pathfind checking for completion as paths come off the open list, the cost of the cheapest path to the target
+// added to the open list so far, or 0 if there is none; paths that can't beat it aren't added
+#define Astar_Pathfind_Goal_Bound               58
+// With Astar_Pathfind_Control_Flag_Partial, the path to the node nearest the target that the pathfind reached, if it was
+// cut off or terminated; an A* path data structure
+#define Astar_Pathfind_Partial_Path             59
+// For a pathfind done over the abstract graph by the hierarchy module, astar_hierarchy.c, a mapping of the node keys of
+// the entrances linked with the starting or target node to the paths found linking them, 0 where there is none
+#define Astar_Pathfind_Hierarchy_Paths          60
+// For a pathfind done over the abstract graph by the hierarchy module, the Astar_Pathfind_Cycle_Index of the cycle in
+// which a path linking its starting or target node was last looked for
+#define Astar_Pathfind_Hierarchy_Cycle          61
+
+#define Astar_Pathfind_Fields                   62
+
+// A* Meeting Data Structure
+//
+// Tracks a node reached by both searches of a bidirectional pathfind.
+
+// The forward search's search node for the node
+#define Astar_Meeting_Forward                   0
+// The backward search's search node for the node
+#define Astar_Meeting_Backward                  1
+// The cost of the complete path through the node
+#define Astar_Meeting_Cost                      2
+
+#define Astar_Meeting_Fields                    3
+
+// A* Batch Data Structure
+//
+// Tracks a set of pathfinding queries made together with astar_find_paths().
+//
+// Usage: astar_find_paths() returns this data structure, and the callback given to it receives it as its argument
+// once every query has its result; the most relevant field is Astar_Batch_Results.
+
+// The ({ from, to }) pairs given to astar_find_paths()
+#define Astar_Batch_Queries                     0
+// The results of the queries, in the same order: A* path data structures, or Astar_Result_* codes, with
+// Astar_Result_Processing for those still under way
+#define Astar_Batch_Results                     1
+// The pathfind data structures doing the searching, one for each starting node with queries the cache didn't answer
+#define Astar_Batch_Pathfinds                   2
+// The number of those pathfinds still under way
+#define Astar_Batch_Pending                     3
+// The callback given to astar_find_paths()
+#define Astar_Batch_Callback                    4
+// The extra value given to astar_find_paths()
+#define Astar_Batch_Extra                       5
+// The control flags given to astar_find_paths()
+#define Astar_Batch_Control_Flags               6
+// ({ cache entry, search node chain }) pairs for the results to cache when the batch completes
+#define Astar_Batch_Cache_Entries               7
+
+#define Astar_Batch_Fields                      8
+
+// A* Hierarchy Build Data Structure
+//
+// Tracks the construction of the abstract graph used by the hierarchical
+// search module, astar_hierarchy.c.
+//
+// Usage: The callback given to astar_build_hierarchy() receives this data
+// structure as its argument when the build completes.
+
+// The nodes discovered so far, in the order their neighbors are examined; may have unused space at the end
+#define Astar_Hierarchy_Build_Queue             0
+// The position in Astar_Hierarchy_Build_Queue of the next node to examine
+#define Astar_Hierarchy_Build_Queue_Index       1
+// A mapping of the node keys of the nodes discovered
+#define Astar_Hierarchy_Build_Seen              2
+// A mapping of cluster keys to mappings of the node keys of each cluster's entrances to the entrance nodes
+#define Astar_Hierarchy_Build_Entrances         3
+// A mapping of node keys to the abstract graph links leaving the node, in the form returned by a neighbors rule, with
+// each edge being an A* path data structure for the path the link stands for
+#define Astar_Hierarchy_Build_Links             4
+// A list of ({ from, to, cluster key }) entrance pairs to find paths between
+#define Astar_Hierarchy_Build_Pairs             5
+// The position in Astar_Hierarchy_Build_Pairs of the next pair to find a path between
+#define Astar_Hierarchy_Build_Pair_Index        6
+// The callback to call when the build completes
+#define Astar_Hierarchy_Build_Callback          7
+// A pathfind data structure used for calling the instance's rules during the build
+#define Astar_Hierarchy_Build_Pathfind          8
+// The number of nodes in Astar_Hierarchy_Build_Queue
+#define Astar_Hierarchy_Build_Queue_Count       9
+
+#define Astar_Hierarchy_Build_Fields            10
+
+// A* Grid Description Data Structure
+//
+// Describes a uniform-cost grid to the grid module, astar_grid.c, which
+// searches such grids with jump point search.
+//
+// Usage: The instance's grid rule returns this data structure.  Nodes on
+// the grid are ({ x, y }) arrays.
+
+// The smallest x coordinate on the grid
+#define Astar_Grid_Min_X                        0
+// The smallest y coordinate on the grid
+#define Astar_Grid_Min_Y                        1
+// The largest x coordinate on the grid
+#define Astar_Grid_Max_X                        2
+// The largest y coordinate on the grid
+#define Astar_Grid_Max_Y                        3
+// A closure called with an x coordinate, a y coordinate and the pathfind data structure, returning true if the cell
+// there can be entered
+#define Astar_Grid_Passable                     4
+// 4 if moves are only along the axes, 8 if diagonal moves are allowed as well
+#define Astar_Grid_Connectivity                 5
+// The cost of a diagonal move, or 0 for the square root of 2; moves along the axes cost 1
+#define Astar_Grid_Diagonal_Cost                6
+
+#define Astar_Grid_Fields                       7
+
+// A* Replan Data Structure
+//
+// Tracks a persistent search, as kept by the incremental replanning module,
+// astar_replan.c, between replans.
+//
+// Usage: astar_open_search() returns this data structure, and it is passed
+// back to the module's other functions.  The callback given to
+// astar_open_search() receives it as its argument; the most relevant field
+// is Astar_Replan_Result.
+
+// The pathfind data structure used for calling the instance's rules; see astar_replan.c for how it is set up
+#define Astar_Replan_Pathfind                   0
+// The node the agent is at, which paths are found from
+#define Astar_Replan_Start                      1
+// The node paths are found to
+#define Astar_Replan_Goal                       2
+// The start node as of the most recent replan, for adjusting queue priorities when the start moves
+#define Astar_Replan_Last_Start                 3
+// The accumulated adjustment to queue priorities from moves of the start node
+#define Astar_Replan_Key_Modifier               4
+// A mapping of node keys to the cost of the best path found from the node to the goal (g); absent means no path
+#define Astar_Replan_Costs                      5
+// A mapping of node keys to the one-step lookahead cost from the node to the goal (rhs); absent means no path
+#define Astar_Replan_Lookahead                  6
+// A mapping of node keys to the nodes they stand for
+#define Astar_Replan_Nodes                      7
+// The priority queue: a binary min-heap of ({ primary, secondary, node key }) entries
+#define Astar_Replan_Queue                      8
+// The number of entries held in Astar_Replan_Queue
+#define Astar_Replan_Queue_Count                9
+// A mapping of node keys to their current queue entries; entries in the heap that aren't here are stale
+#define Astar_Replan_Queued                     10
+// A mapping of node keys to mappings of node keys to edge costs set by astar_update_edge()
+#define Astar_Replan_Cost_Overrides             11
+// The result of the most recent replan: a path, Astar_Result_Processing or another Astar_Result_* code
+#define Astar_Replan_Result                     12
+// The 'callback' argument astar_open_search() was called with, if any
+#define Astar_Replan_Callback                   13
+// The number of nodes whose costs were settled by replans, for gauging how much each replan repaired
+#define Astar_Replan_Stats_Expanded             14
+
+#define Astar_Replan_Fields                     15
+
+// Special edge cost values for astar_update_edge()
+
+// The edge cannot be traversed
+#define Astar_Replan_Cost_Blocked               -1
+// The edge's cost should again be what the neighbors rule says it is
+#define Astar_Replan_Cost_Rule                  -2
+
+// A* Flood Data Structure
+//
+// Tracks a distance field, as built by the flood module, astar_flood.c: the
+// cost from every node reached to a single origin node, and the step to
+// take from each toward it.
+//
+// Usage: astar_flood() returns this data structure, and it is passed to the
+// module's lookup functions.  The callback given to astar_flood() receives
+// it as its argument; the most relevant field is Astar_Flood_Result.
+
+// The pathfind data structure used for calling the instance's rules; see astar_flood.c for how it is set up
+#define Astar_Flood_Pathfind                    0
+// The node the field leads to
+#define Astar_Flood_Origin                      1
+// A mapping of node keys to Astar_Flood_Entry_* structures for the nodes whose costs are settled
+#define Astar_Flood_Field                       2
+// A mapping of node keys to the cheapest cost seen so far for nodes not yet settled
+#define Astar_Flood_Tentative                   3
+// The open list: a binary min-heap of ({ cost, node key, node, edge, next node }) entries
+#define Astar_Flood_Queue                       4
+// The number of entries held in Astar_Flood_Queue
+#define Astar_Flood_Queue_Count                 5
+// The cost beyond which the flood does not go, or 0 for no limit
+#define Astar_Flood_Max_Cost                    6
+// The result of the flood: Astar_Flood_Field's mapping once complete, Astar_Result_Processing while continuing via the
+// scheduling rule, or Astar_Result_Cut_Off or Astar_Result_Cannot_Continue if it couldn't
+#define Astar_Flood_Result                      7
+// The 'callback' argument astar_flood() was called with, if any
+#define Astar_Flood_Callback                    8
+// The validate key the flood was built under, for caching
+#define Astar_Flood_Validate_Key                9
+// The number of nodes settled
+#define Astar_Flood_Stats_Expanded              10
+
+#define Astar_Flood_Fields                      11
 
-#define Astar_Pathfind_Fields                   16
+// A* Flood Entry Data Structure
+//
+// Tracks one node of a distance field.
+
+// The cost of the cheapest path from the node to the origin
+#define Astar_Flood_Entry_Cost                  0
+// The edge to take from the node toward the origin, once known (see Astar_Flood_Entry_Resolved)
+#define Astar_Flood_Entry_Edge                  1
+// The node that edge leads to
+#define Astar_Flood_Entry_Next                  2
+// Whether Astar_Flood_Entry_Edge is known; without a reverse neighbors rule, edges are looked up as they are asked for
+#define Astar_Flood_Entry_Resolved              3
+// The node itself
+#define Astar_Flood_Entry_Node                  4
+
+#define Astar_Flood_Entry_Fields                5
+
+// A* Landmark Build Data Structure
+//
+// Tracks the selection of landmarks and the floods from them done by
+// astar_build_landmarks() in the flood module, astar_flood.c.
+//
+// Usage: The callback given to astar_build_landmarks() receives this data
+// structure as its argument when the build completes.
+
+// The landmarks chosen so far, beginning with those given to astar_build_landmarks()
+#define Astar_Landmark_Build_Landmarks          0
+// The number of landmarks wanted
+#define Astar_Landmark_Build_Count              1
+// The position in Astar_Landmark_Build_Landmarks of the landmark being flooded from
+#define Astar_Landmark_Build_Index              2
+// A mapping of node keys to arrays of the costs from the node to each landmark, -1.0 where it can't reach one
+#define Astar_Landmark_Build_Table              3
+// A mapping of node keys to nodes, for choosing further landmarks from
+#define Astar_Landmark_Build_Nodes              4
+// The callback to call when the build completes
+#define Astar_Landmark_Build_Callback           5
+// A pathfind data structure used for keeping to the run limit while choosing landmarks
+#define Astar_Landmark_Build_Pathfind           6
+// The node keys left to examine in choosing the next landmark, or 0 if none is being chosen
+#define Astar_Landmark_Build_Scan_Keys          7
+// The position in Astar_Landmark_Build_Scan_Keys of the next node key to examine
+#define Astar_Landmark_Build_Scan_Index         8
+// The node key of the best candidate for the next landmark found so far
+#define Astar_Landmark_Build_Scan_Best          9
+// The cost from the best candidate to the nearest landmark, -1.0 if there is none yet
+#define Astar_Landmark_Build_Scan_Best_Cost     10
+
+#define Astar_Landmark_Build_Fields             11
+
+// A* Scheduled Continuation Data Structure
+//
+// Tracks a pathfind waiting in the queue of the scheduler daemon,
+// astar_scheduler.c, for its next processing cycle.
+
+// The pathfind's priority, from Astar_Pathfind_Priority
+#define Astar_Scheduled_Priority                0
+// The pathfind's deadline, from Astar_Pathfind_Deadline, or 0 for none
+#define Astar_Scheduled_Deadline                1
+// The order the continuation was queued in, so that pathfinds of equal standing take turns
+#define Astar_Scheduled_Sequence                2
+// The function to call to continue the pathfind
+#define Astar_Scheduled_Function                3
+// The pathfind data structure to call it with
+#define Astar_Scheduled_Pathfind                4
+
+#define Astar_Scheduled_Fields                  5
+
+// A* Metrics Data Structure
+//
+// Tracks the totals kept by the metrics daemon, astar_metrics.c, for one
+// program using the A* module, covering its blueprint and all its clones.
+//
+// Usage: query_astar_metrics() in the metrics daemon returns a mapping of
+// load names to these data structures.
+
+// The number of pathfinds finished
+#define Astar_Metrics_Pathfinds                 0
+// A mapping of results to the number of pathfinds finishing with each; Astar_Result_* codes count as themselves, and
+// successful pathfinds count as 0
+#define Astar_Metrics_Results                   1
+// The total of the pathfinds' cycle counts (Astar_Pathfind_Cycle_Index)
+#define Astar_Metrics_Cycles                    2
+// The total wall time, in microseconds, from the pathfinds' start to their finish
+#define Astar_Metrics_Time                      3
+// The total of the pathfinds' cache hits (Astar_Pathfind_Stats_Cache_Hits)
+#define Astar_Metrics_Cache_Hits                4
+// The total of the pathfinds' cache misses (Astar_Pathfind_Stats_Cache_Misses)
+#define Astar_Metrics_Cache_Misses              5
+// The total of the pathfinds' expanded paths (Astar_Pathfind_Stats_Expanded)
+#define Astar_Metrics_Expanded                  6
+
+#define Astar_Metrics_Fields                    7
+
+// A* Slow Pathfind Data Structure
+//
+// Tracks one of the slowest pathfinds seen by the metrics daemon.
+
+// The name of the object the pathfind was done by
+#define Astar_Slow_Pathfind_Object              0
+// The node key of the pathfind's starting node
+#define Astar_Slow_Pathfind_From_Key            1
+// The node key of the pathfind's target node
+#define Astar_Slow_Pathfind_To_Key              2
+// The wall time, in microseconds, from the pathfind's start to its finish
+#define Astar_Slow_Pathfind_Time                3
+// The pathfind's cycle count
+#define Astar_Slow_Pathfind_Cycles              4
+// The pathfind's result, counted as for Astar_Metrics_Results
+#define Astar_Slow_Pathfind_Result              5
+// The time() the pathfind finished
+#define Astar_Slow_Pathfind_Timestamp           6
+
+#define Astar_Slow_Pathfind_Fields              7
+
+// A* Trace Record Data Structure
+//
+// Records an event in a pathfind traced with Astar_Pathfind_Control_Flag_Trace.
+
+// What happened, as an Astar_Trace_Event_* value
+#define Astar_Trace_Event                       0
+// For an expansion, the node key of the node expanded; for a cache event, the ({ from key, to key }) looked up or stored
+#define Astar_Trace_Key                         1
+// For an expansion, the cost of the path to the node, not counting its distance from the target (g)
+#define Astar_Trace_Cost                        2
+// For an expansion, the node's distance from the target by the distance rule, as weighted (h)
+#define Astar_Trace_Distance                    3
+// The value of Astar_Pathfind_Cycle_Index when the event happened
+#define Astar_Trace_Cycle                       4
+
+#define Astar_Trace_Fields                      5
+
+// Trace record events
+
+// A node was expanded, having its neighbors examined, by the forward search
+#define Astar_Trace_Event_Expand                1
+// A node was expanded by the backward search of a bidirectional pathfind
+#define Astar_Trace_Event_Expand_Backward       2
+// The cache had a result for the pathfind
+#define Astar_Trace_Event_Cache_Hit             3
+// The cache had no result for the pathfind
+#define Astar_Trace_Event_Cache_Miss            4
+// The pathfind's result was stored in the cache
+#define Astar_Trace_Event_Cache_Store           5
 
 // A* Pathfinder Control Flags
 //
@@ -95,6 +592,72 @@
 #define Astar_Pathfind_Control_Flag_Uncache     0x00000004
 // If present, the presence of a callback will not cause processing to continue via call_out()
 #define Astar_Pathfind_Control_Flag_No_Continue 0x00000008
+// If present, a node reached again by a cheaper route has the route it is reached by updated, and nodes are only checked
+// for completion as they are taken off the open list rather than as they are reached.  This finds an optimal path so long
+// as the distance rule never overestimates, at the cost of a somewhat larger search than the default of keeping the first
+// route found to each node.
+#define Astar_Pathfind_Control_Flag_Decrease_Key 0x00000010
+// If present, the pathfind searches backward from Astar_Pathfind_To at the same time as it searches forward from
+// Astar_Pathfind_From, and finishes when the two searches have met and no cheaper meeting remains possible.  Each search
+// keeps cheaper routes as with Astar_Pathfind_Control_Flag_Decrease_Key.  The completion rule is not used; the pathfind
+// needs a specific target.  See the notes on the reverse neighbors rule in astar.c; an instance with a reverse neighbors
+// rule and a distance rule also needs a reverse distance rule.
+#define Astar_Pathfind_Control_Flag_Bidirectional 0x00000020
+// If present, the time spent in each of the instance's rules is accumulated in the Astar_Pathfind_Stats_*_Time fields.
+// This costs two utime() calls per rule call, so it is meant for looking into where a pathfind's time goes.
+#define Astar_Pathfind_Control_Flag_Timing      0x00000040
+// If present, each node expansion and cache decision is recorded in Astar_Pathfind_Trace, keeping the most recent of them
+// up to the instance's trace limit; see astar_trace() and astar_trace_render() in astar.c.
+#define Astar_Pathfind_Control_Flag_Trace       0x00000080
+// If present, nodes are only checked for completion as they are taken off the open list, as with
+// Astar_Pathfind_Control_Flag_Decrease_Key, but without routes to nodes being updated, so the completion rule is called once
+// per node expanded rather than once per neighbor generated.  Under either flag, once a path to the target is on the open
+// list, paths that can't come in under its cost are left off it.
+#define Astar_Pathfind_Control_Flag_Goal_On_Pop 0x00000100
+// If present, a pathfind that ends with Astar_Result_Cut_Off, Astar_Result_Cannot_Continue or Astar_Result_Terminated
+// leaves the path to the node nearest the target it reached, by the distance rule, in Astar_Pathfind_Partial_Path, so
+// that whatever is waiting on it can set off that way and search on from there.
+#define Astar_Pathfind_Control_Flag_Partial     0x00000200
+
+// A* Rule Dependency Flags
+//
+// Flag values for set_astar_rule_dependencies(), declaring which parts of the pathfind data structure the instance's
+// rules rely on that the pathfinder would not otherwise maintain
+
+// The rules read Astar_Pathfind_Active_Path, so it should be assembled for every path worked with
+#define Astar_Rule_Dependency_Active_Path       0x00000001
+
+// The rules' results depend on Astar_Pathfind_Active_Edge as well as the active node, so neighbor lists can't be cached
+#define Astar_Rule_Dependency_Active_Edge       0x00000002
+
+// A* Tie-Breaking Policies
+//
+// Values for set_astar_tie_breaking(), choosing which of the paths on the open list with the same cost is worked with
+// first.
+
+// No preference; paths of equal cost are worked with together, in no particular order
+#define Astar_Tie_Breaking_None                 0
+// Prefer the path with the least distance left to the target, i.e. the most cost behind it
+#define Astar_Tie_Breaking_Low_Distance         1
+// Prefer the path with the most distance left to the target
+#define Astar_Tie_Breaking_High_Distance        2
+// Prefer the path reached first
+#define Astar_Tie_Breaking_First_Reached        3
+// Prefer the path reached most recently
+#define Astar_Tie_Breaking_Last_Reached         4
+
+// A* Cache Eviction Policies
+//
+// Values for set_astar_cache_eviction(), choosing which entry to evict when the cache is over its limits.  The entry
+// evicted is chosen from among those due to expire soonest by astar_prune_cache()'s reckoning, which takes both its
+// hits and its most recent hit into account, so every policy favors entries that are both stale and little-used.
+
+// Evict the first entry found among those due to expire soonest
+#define Astar_Cache_Eviction_Expiry             0
+// Evict the least recently requested of the entries due to expire soonest
+#define Astar_Cache_Eviction_LRU                1
+// Evict the least often requested of the entries due to expire soonest
+#define Astar_Cache_Eviction_LFU                2
 
 // A* Result Codes
 
@@ -116,5 +679,42 @@
 #define Astar_Prune_Cache_Default_Threshold     7200
 // Each cache hit extends a cache entry's lifespan by this many seconds
 #define Astar_Prune_Cache_Hit_Factor            60
+// Approximate memory taken by each value held in a cache entry, for reckoning cache sizes in bytes
+#define Astar_Cache_Value_Bytes                 16
+// Approximate memory taken by each array in a cache entry, beyond the values it holds
+#define Astar_Cache_Array_Bytes                 32
+// Cache entries are filed in the expiry index by expiry time, in buckets spanning this many seconds
+#define Astar_Prune_Cache_Bucket_Size           300
+// The format written by astar_save_cache(); snapshots in any other format are rejected by astar_restore_cache()
+#define Astar_Cache_Snapshot_Current_Format     2
+// Default number of cache entries astar_restore_cache() restores per call
+#define Astar_Cache_Restore_Default_Slice       100
+// Default number of trace records kept for a pathfind traced with Astar_Pathfind_Control_Flag_Trace
+#define Astar_Trace_Default_Limit               1000
+// Default number of pathfinds kept in the metrics daemon's slow pathfind log
+#define Astar_Metrics_Default_Slow_Log_Size     20
+// A processing cycle budget in eval ticks for set_astar_adaptive_run_limit(), for instances without particular needs
+#define Astar_Adaptive_Run_Limit_Default_Budget (__MAX_EVAL_COST__ / 4)
+// The most iterations the adaptive run limit lets go by between checks
+#define Astar_Adaptive_Run_Limit_Max_Interval   64
+// The adaptive run limit ends a processing cycle when fewer than this many eval ticks remain of the driver's limit
+#define Astar_Adaptive_Run_Limit_Reserve        20000
+// Default heuristic weight for the first round of an anytime pathfind
+#define Astar_Anytime_Default_Weight            2.5
+// Default amount the heuristic weight of an anytime pathfind is lowered by each round
+#define Astar_Anytime_Default_Step              0.5
+// Default number of eval ticks the scheduler daemon spends continuing pathfinds each heartbeat
+#define Astar_Scheduler_Default_Budget          200000
+
+// The metrics daemon every pathfind reports to when it finishes.  Defining Astar_Metrics_Disabled (for instance in the
+// driver's auto-include file) leaves reporting out of the module altogether.
+#ifndef Astar_Metrics_Daemon
+#define Astar_Metrics_Daemon                    "/mod/algorithm/astar_metrics"
+#endif
+
+// The scheduler daemon used by instances that have turned on central scheduling
+#ifndef Astar_Scheduler_Daemon
+#define Astar_Scheduler_Daemon                  "/mod/algorithm/astar_scheduler"
+#endif
 
 #endif
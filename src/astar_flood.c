@@ -0,0 +1,679 @@
+// Distance Field Module
+//
+// Builds on the A* search module to find the cheapest paths from every
+// node within reach to a single origin node at once, by flooding outward
+// from the origin in the manner of Dijkstra's algorithm, without a
+// heuristic.  The result is a distance field: for each node reached, the
+// cost of getting from it to the origin and the edge to take toward it.
+// When a crowd of agents is headed for the same place, one flood serves
+// them all; each agent, wherever it is, takes the next step by looking it
+// up, rather than having a pathfind done for it.
+
+// Usage: inherit this module in place of /mod/algorithm/astar, and
+// configure the A* rules as usual.  Then:
+//
+//     mixed * flood = astar_flood(goal);
+//
+// and for each agent:
+//
+//     mixed edge = astar_flood_next_edge(flood, where_the_agent_is);
+//
+// The flood works backward from the origin, so it uses the reverse
+// neighbors rule if there is one, or else the neighbors rule, in which
+// case the graph is taken to be symmetric and the edges toward the origin
+// are looked up with the neighbors rule as they are asked for.  When the
+// instance's rules are called for a flood, pathfind[Astar_Pathfind_From] is
+// the origin and pathfind[Astar_Pathfind_To] is 0.  The flood runs in parts
+// via the scheduling rule, subject to the run limit, if it is given a
+// callback.  With set_astar_flood_caching(1), completed floods are kept
+// and handed back for later requests from the same origin, until
+// astar_clear_cache() or a targeted invalidation of one of their nodes.
+//
+// Floods also give a heuristic for graphs without coordinates to base a
+// distance rule on: astar_build_landmarks() floods from a handful of
+// landmark nodes, and astar_landmark_distance() is a distance rule that
+// bounds the cost between two nodes by their costs to the landmarks.
+
+#include <astar.h>
+
+inherit "/mod/algorithm/astar";
+
+// SECTION: Instance configuration
+
+// Flood caching
+//
+// Keeps completed floods, as a mapping of validate keys to mappings of
+// origin node keys to flood data structures.  As with the A* cache, this
+// should only be turned on if the neighbors rule always gives the same
+// results for a node, and a validate key rule is needed for floods using
+// 'validate' to be cached.
+
+private mapping flood_cache;
+
+void set_astar_flood_caching(int val) {
+	flood_cache = val ? ([]) : 0;
+}
+
+int query_astar_flood_caching() {
+	return flood_cache && 1;
+}
+
+// The landmarks built by astar_build_landmarks(), and a mapping of node keys
+// to arrays of the costs from each node to each landmark, -1.0 where the
+// node can't reach the landmark.
+
+private mixed * landmarks;
+private mapping landmark_table;
+
+mixed * query_astar_landmarks() {
+	return landmarks;
+}
+
+// SECTION: Internal support functions
+
+// flood_key()
+//
+// Node key retrieval, as done by the A* module.
+
+private mixed flood_key(mixed node) {
+	return astar_node_key(node);
+}
+
+// flood_node()
+//
+// Constrains a node's representation, as the A* module does.
+
+private mixed flood_node(mixed node) {
+	closure rule = query_astar_node_rule();
+	return rule ? funcall(rule, node) : node;
+}
+
+// flood_neighbors()
+//
+// Retrieves the neighbors of a node using the reverse neighbors rule if
+// 'reverse' is true and there is one, or otherwise the neighbors rule or
+// batch neighbors rule.
+
+private mixed flood_neighbors(mixed * pathfind, mixed node, int reverse) {
+	pathfind[Astar_Pathfind_Active_Node] = node;
+	pathfind[Astar_Pathfind_Active_Edge] = 0;
+	closure rule = (reverse && query_astar_reverse_neighbors_rule()) || query_astar_neighbors_rule();
+	if(rule)
+		return funcall(rule, pathfind);
+	pathfind[Astar_Pathfind_Active_Nodes] = ({ node });
+	pathfind[Astar_Pathfind_Active_Edges] = ({ 0 });
+	mixed out = funcall(query_astar_batch_neighbors_rule(), pathfind);
+	pathfind[Astar_Pathfind_Active_Nodes] = 0;
+	pathfind[Astar_Pathfind_Active_Edges] = 0;
+	return pointerp(out) ? out[0] : out;
+}
+
+// flood_queue_push()
+//
+// Adds an entry to a flood's open list.
+
+private void flood_queue_push(mixed * flood, mixed * entry) {
+	mixed * heap = flood[Astar_Flood_Queue];
+	int ix = flood[Astar_Flood_Queue_Count]++;
+	if(ix >= sizeof(heap)) {
+		heap += allocate(sizeof(heap) || 1);
+		flood[Astar_Flood_Queue] = heap;
+	}
+	while(ix > 0) {
+		int parent = (ix - 1) >> 1;
+		if(heap[parent][0] <= entry[0])
+			break;
+		heap[ix] = heap[parent];
+		ix = parent;
+	}
+	heap[ix] = entry;
+}
+
+// flood_queue_pop()
+//
+// Removes the entry at the top of a flood's open list.
+
+private void flood_queue_pop(mixed * flood) {
+	mixed * heap = flood[Astar_Flood_Queue];
+	int count = --flood[Astar_Flood_Queue_Count];
+	mixed * last = heap[count];
+	heap[count] = 0;
+	if(!count)
+		return;
+	int ix = 0;
+	for(;;) {
+		int child = (ix << 1) + 1;
+		if(child >= count)
+			break;
+		if(child + 1 < count && heap[child + 1][0] < heap[child][0])
+			child++;
+		if(heap[child][0] >= last[0])
+			break;
+		heap[ix] = heap[child];
+		ix = child;
+	}
+	heap[ix] = last;
+}
+
+// flood_entry()
+//
+// Returns the field entry for a node, as constrained by the node rule, or 0
+// if the flood didn't reach it.
+
+private mixed * flood_entry(mixed * flood, mixed node) {
+	return flood[Astar_Flood_Field][flood_key(node)];
+}
+
+// flood_resolve()
+//
+// Fills in the edge toward the origin for a field entry, if it isn't known
+// yet, by finding the neighbor of the node that the entry leads to.  If the
+// neighbors rule can't give the neighbor right away, the edge is left
+// unknown, to be looked up again next time.
+
+private void flood_resolve(mixed * flood, mixed node, mixed * entry) {
+	if(entry[Astar_Flood_Entry_Resolved])
+		return;
+	mixed next_key = flood_key(entry[Astar_Flood_Entry_Next]);
+	mixed neighbors = flood_neighbors(flood[Astar_Flood_Pathfind], node, 0);
+	if(!pointerp(neighbors))
+		return;
+	foreach(mixed * neighbor : neighbors)
+		if(flood_key(neighbor[0]) == next_key) {
+			entry[Astar_Flood_Entry_Edge] = neighbor[1];
+			entry[Astar_Flood_Entry_Resolved] = 1;
+			return;
+		}
+}
+
+private void astar_flood_step(mixed * flood);
+
+// flood_finish()
+//
+// Records the result of a flood and notifies its callback, caching the
+// flood if it is complete and caching is on.
+
+private void flood_finish(mixed * flood, mixed result) {
+	flood[Astar_Flood_Result] = result;
+	mixed * pathfind = flood[Astar_Flood_Pathfind];
+	if(mappingp(result)) {
+		// The open list and tentative costs are of no more use.
+		flood[Astar_Flood_Queue] = ({});
+		flood[Astar_Flood_Queue_Count] = 0;
+		flood[Astar_Flood_Tentative] = ([]);
+		if(flood_cache && (flood[Astar_Flood_Validate_Key] || !pathfind[Astar_Pathfind_Validate])) {
+			mapping validate_cache = flood_cache[flood[Astar_Flood_Validate_Key]] ||= ([]);
+			validate_cache[flood_key(flood[Astar_Flood_Origin])] = flood;
+		}
+	}
+	pathfind[Astar_Pathfind_Result] = result;
+	if(flood[Astar_Flood_Callback])
+		funcall(flood[Astar_Flood_Callback], flood);
+}
+
+// astar_flood_step()
+//
+// Performs the work of a flood; takes a flood data structure as argument,
+// and can resume from any point in the flood, continuing via the
+// scheduling rule if it has a callback and the run limit is reached or the
+// neighbors rule needs ongoing processing.
+
+private void astar_flood_step(mixed * flood) {
+	mixed * pathfind = flood[Astar_Flood_Pathfind];
+	mapping field = flood[Astar_Flood_Field];
+	mapping tentative = flood[Astar_Flood_Tentative];
+	closure validate = pathfind[Astar_Pathfind_Validate];
+	mixed max_cost = flood[Astar_Flood_Max_Cost];
+	int resolved = query_astar_reverse_neighbors_rule() && 1;
+	astar_cycle_begin(pathfind);
+	while(flood[Astar_Flood_Queue_Count]) {
+		mixed * top = flood[Astar_Flood_Queue][0];
+		mixed key = top[1];
+		// Entries for nodes settled by a cheaper one beforehand are stale.
+		if(member(field, key)) {
+			flood_queue_pop(flood);
+			continue;
+		}
+		pathfind[Astar_Pathfind_Cycle_Iterations]++;
+		if(astar_run_limit_reached(pathfind)) {
+			if(!flood[Astar_Flood_Callback])
+				return flood_finish(flood, Astar_Result_Cut_Off);
+			flood[Astar_Flood_Result] = Astar_Result_Processing;
+			funcall(query_astar_scheduling_rule() || #'call_out, #'astar_flood_step, 2, flood);
+			return;
+		}
+		mixed neighbors = flood_neighbors(pathfind, top[2], 1);
+		if(neighbors == Astar_Result_Processing) {
+			if(!flood[Astar_Flood_Callback])
+				return flood_finish(flood, Astar_Result_Cannot_Continue);
+			flood[Astar_Flood_Result] = Astar_Result_Processing;
+			funcall(query_astar_scheduling_rule() || #'call_out, #'astar_flood_step, 2, flood);
+			return;
+		}
+		if(!pointerp(neighbors))
+			raise_error("Invalid return value from neighbors rule");
+		flood_queue_pop(flood);
+		mixed * entry = allocate(Astar_Flood_Entry_Fields);
+		entry[Astar_Flood_Entry_Cost] = top[0];
+		entry[Astar_Flood_Entry_Edge] = top[3];
+		entry[Astar_Flood_Entry_Next] = top[4];
+		entry[Astar_Flood_Entry_Resolved] = resolved || !top[4];
+		entry[Astar_Flood_Entry_Node] = top[2];
+		field[key] = entry;
+		map_delete(tentative, key);
+		flood[Astar_Flood_Stats_Expanded]++;
+		foreach(mixed * neighbor : neighbors) {
+			mixed node = neighbor[0];
+			mixed neighbor_key = flood_key(node);
+			if(member(field, neighbor_key))
+				continue;
+			float cost = top[0] + neighbor[2];
+			if(max_cost && cost > max_cost)
+				continue;
+			if(member(tentative, neighbor_key) && tentative[neighbor_key] <= cost)
+				continue;
+			if(validate) {
+				pathfind[Astar_Pathfind_Active_Node] = node;
+				pathfind[Astar_Pathfind_Active_Edge] = neighbor[1];
+				if(!funcall(validate, pathfind))
+					continue;
+			}
+			tentative[neighbor_key] = cost;
+			// With a reverse neighbors rule, the edge given is the one from the neighbor toward us, as we want it.
+			flood_queue_push(flood, ({ cost, neighbor_key, node, resolved && neighbor[1], top[2] }));
+		}
+	}
+	flood_finish(flood, field);
+}
+
+varargs mixed * astar_flood(mixed origin, closure validate, closure callback, float max_cost, mixed extra);
+private void landmark_flood_done(mixed * flood);
+
+// flood_cached()
+//
+// Returns the flood kept by flood caching from the node with key
+// 'origin_key', under validate key 'validate_key', if there is one that
+// reaches as far as 'max_cost' (0 for no limit); otherwise returns 0.
+
+private mixed * flood_cached(mixed validate_key, mixed origin_key, float max_cost) {
+	if(!flood_cache)
+		return 0;
+	mapping validate_cache = flood_cache[validate_key];
+	mixed * cached = validate_cache && validate_cache[origin_key];
+	if(cached && (!cached[Astar_Flood_Max_Cost] || (max_cost && cached[Astar_Flood_Max_Cost] >= max_cost)))
+		return cached;
+	return 0;
+}
+
+private void landmark_next(mixed * build);
+
+// landmark_continue()
+//
+// Schedules the continuation of a landmark build via the scheduling rule.
+
+private void landmark_continue(mixed * build) {
+	funcall(query_astar_scheduling_rule() || #'call_out, #'landmark_next, 2, build);
+}
+
+// landmark_next()
+//
+// Floods from the next landmark of a landmark build, choosing it first if
+// the landmarks given have all been used: the node farthest from all of the
+// landmarks so far, by its cost to the nearest of them, which spreads the
+// landmarks out to the edges of the graph, where they give the best bounds.
+// The search for it continues via the scheduling rule whenever the run
+// limit rule says to.
+
+private void landmark_record(mixed * build, mixed * flood);
+
+private void landmark_next(mixed * build) {
+	mixed * chosen = build[Astar_Landmark_Build_Landmarks];
+	int index = build[Astar_Landmark_Build_Index];
+	if(index >= build[Astar_Landmark_Build_Count]) {
+		landmarks = chosen;
+		landmark_table = build[Astar_Landmark_Build_Table];
+		if(build[Astar_Landmark_Build_Callback])
+			funcall(build[Astar_Landmark_Build_Callback], build);
+		return;
+	}
+	if(index >= sizeof(chosen)) {
+		mixed * pathfind = build[Astar_Landmark_Build_Pathfind];
+		mapping table = build[Astar_Landmark_Build_Table];
+		astar_cycle_begin(pathfind);
+		mixed * keys = build[Astar_Landmark_Build_Scan_Keys];
+		if(!keys) {
+			keys = m_indices(table);
+			build[Astar_Landmark_Build_Scan_Keys] = keys;
+			build[Astar_Landmark_Build_Scan_Index] = 0;
+			build[Astar_Landmark_Build_Scan_Best] = 0;
+			build[Astar_Landmark_Build_Scan_Best_Cost] = -1.0;
+		}
+		while(build[Astar_Landmark_Build_Scan_Index] < sizeof(keys)) {
+			if(pathfind[Astar_Pathfind_Cycle_Iterations]++ && astar_run_limit_reached(pathfind))
+				return landmark_continue(build);
+			mixed key = keys[build[Astar_Landmark_Build_Scan_Index]++];
+			mixed * costs = table[key];
+			float nearest = __FLOAT_MAX__;
+			for(int ix = 0; ix < index; ix++)
+				if(costs[ix] >= 0.0 && costs[ix] < nearest)
+					nearest = costs[ix];
+			if(nearest < __FLOAT_MAX__ && nearest > build[Astar_Landmark_Build_Scan_Best_Cost]) {
+				build[Astar_Landmark_Build_Scan_Best] = key;
+				build[Astar_Landmark_Build_Scan_Best_Cost] = nearest;
+			}
+		}
+		build[Astar_Landmark_Build_Scan_Keys] = 0;
+		// Every node reached is a landmark already; there's nowhere else for one to go.
+		if(build[Astar_Landmark_Build_Scan_Best_Cost] <= 0.0) {
+			build[Astar_Landmark_Build_Count] = index;
+			return landmark_next(build);
+		}
+		chosen += ({ build[Astar_Landmark_Build_Nodes][build[Astar_Landmark_Build_Scan_Best]] });
+		build[Astar_Landmark_Build_Landmarks] = chosen;
+	}
+	// A flood from the cache would be handed back without the callback being called, so it is recorded here.
+	mixed * cached = flood_cached(0, flood_key(flood_node(chosen[index])), 0);
+	if(cached)
+		return landmark_record(build, cached);
+	astar_flood(chosen[index], 0, #'landmark_flood_done, 0, build);
+}
+
+// landmark_record()
+//
+// Records the costs found by the flood from a landmark and moves on to the
+// next, via the scheduling rule, so that one flood finishing doesn't start
+// the next in the same execution.
+
+private void landmark_record(mixed * build, mixed * flood) {
+	mixed result = flood[Astar_Flood_Result];
+	if(!mappingp(result))
+		raise_error("Landmark flood could not complete");
+	int index = build[Astar_Landmark_Build_Index];
+	int count = build[Astar_Landmark_Build_Count];
+	mapping table = build[Astar_Landmark_Build_Table];
+	mapping nodes = build[Astar_Landmark_Build_Nodes];
+	foreach(mixed key, mixed * entry : result) {
+		mixed * costs = table[key] ||= allocate(count, -1.0);
+		costs[index] = entry[Astar_Flood_Entry_Cost];
+		nodes[key] = entry[Astar_Flood_Entry_Node];
+	}
+	build[Astar_Landmark_Build_Index]++;
+	landmark_continue(build);
+}
+
+// landmark_flood_done()
+//
+// Callback for the floods of a landmark build.
+
+private void landmark_flood_done(mixed * flood) {
+	landmark_record(flood[Astar_Flood_Pathfind][Astar_Pathfind_Extra], flood);
+}
+
+// SECTION: Operational interface
+
+// astar_flood()
+//
+// Builds the distance field leading to 'origin', returning the flood data
+// structure (see the Astar_Flood_* macros in astar.h) that holds it.
+// 'validate', 'callback' and 'extra' are as for astar_find_path(); with a
+// callback, the flood can continue via the scheduling rule, and the
+// callback is called with the flood data structure when it is done.
+// 'max_cost', if given, limits the flood to nodes within that cost of the
+// origin.  If the flood is complete, flood[Astar_Flood_Result] is the
+// mapping of node keys to Astar_Flood_Entry_* structures; see the
+// structure's notes for its other possible values.  A flood found in the
+// cache is returned as it is, without the callback being called.
+
+varargs mixed * astar_flood(mixed origin, closure validate, closure callback, float max_cost, mixed extra) {
+	mixed * pathfind = astar_pathfind_create(origin, 0, validate, callback, Astar_Pathfind_Control_Flag_Uncache, extra);
+	origin = pathfind[Astar_Pathfind_From];
+	mixed origin_key = flood_key(origin);
+	closure validate_key_rule = query_astar_validate_key_rule();
+	mixed validate_key = validate && validate_key_rule && funcall(validate_key_rule, pathfind);
+	mixed * cached = (validate_key || !validate) && flood_cached(validate_key, origin_key, max_cost);
+	if(cached)
+		return cached;
+	mixed * flood = allocate(Astar_Flood_Fields);
+	flood[Astar_Flood_Pathfind] = pathfind;
+	flood[Astar_Flood_Origin] = origin;
+	flood[Astar_Flood_Field] = ([]);
+	flood[Astar_Flood_Tentative] = ([ origin_key : 0.0 ]);
+	flood[Astar_Flood_Queue] = ({ ({ 0.0, origin_key, origin, 0, 0 }) });
+	flood[Astar_Flood_Queue_Count] = 1;
+	flood[Astar_Flood_Max_Cost] = max_cost;
+	flood[Astar_Flood_Callback] = callback;
+	flood[Astar_Flood_Validate_Key] = validate_key;
+	astar_flood_step(flood);
+	return flood;
+}
+
+// astar_flood_next_edge()
+//
+// Returns the edge to take from 'node' toward the origin of a flood, or 0
+// if the flood didn't reach the node or it is the origin.
+
+mixed astar_flood_next_edge(mixed * flood, mixed node) {
+	node = flood_node(node);
+	mixed * entry = flood_entry(flood, node);
+	if(!entry)
+		return 0;
+	flood_resolve(flood, node, entry);
+	return entry[Astar_Flood_Entry_Edge];
+}
+
+// astar_flood_next_node()
+//
+// Returns the node reached by taking the next step from 'node' toward the
+// origin of a flood, or 0 if the flood didn't reach the node or it is the
+// origin.
+
+mixed astar_flood_next_node(mixed * flood, mixed node) {
+	mixed * entry = flood_entry(flood, flood_node(node));
+	return entry && entry[Astar_Flood_Entry_Next];
+}
+
+// astar_flood_cost()
+//
+// Returns the cost of the cheapest path from 'node' to the origin of a
+// flood, or -1.0 if the flood didn't reach the node.
+
+float astar_flood_cost(mixed * flood, mixed node) {
+	mixed * entry = flood_entry(flood, flood_node(node));
+	return entry ? entry[Astar_Flood_Entry_Cost] : -1.0;
+}
+
+// astar_flood_path()
+//
+// Returns the A* path data structure for the path from 'node' to the
+// origin of a flood, or Astar_Result_Impossible if the flood didn't reach
+// the node.
+
+mixed astar_flood_path(mixed * flood, mixed node) {
+	node = flood_node(node);
+	mixed * entry = flood_entry(flood, node);
+	if(!entry)
+		return Astar_Result_Impossible;
+	mixed * path = allocate(Astar_Path_Fields);
+	path[Astar_Path_Nodes] = ({ node });
+	path[Astar_Path_Edges] = ({});
+	path[Astar_Path_Distance] = 0.0;
+	path[Astar_Path_Cost] = entry[Astar_Flood_Entry_Cost];
+	while(entry[Astar_Flood_Entry_Next]) {
+		flood_resolve(flood, node, entry);
+		path[Astar_Path_Edges] += ({ entry[Astar_Flood_Entry_Edge] });
+		node = entry[Astar_Flood_Entry_Next];
+		path[Astar_Path_Nodes] += ({ node });
+		entry = flood_entry(flood, node);
+	}
+	return path;
+}
+
+// astar_clear_flood_cache()
+//
+// Discards the floods kept by flood caching.
+
+void astar_clear_flood_cache() {
+	if(flood_cache)
+		flood_cache = ([]);
+}
+
+// astar_clear_cache()
+//
+// Clears out the A* cache, as in astar.c, and the flood cache with it.  An
+// object using flood caching without path caching can call it too.
+
+void astar_clear_cache() {
+	astar_clear_flood_cache();
+	if(query_astar_caching() || query_astar_neighbor_caching() || !flood_cache)
+		::astar_clear_cache();
+}
+
+// flood_invalidate()
+//
+// Discards the cached floods that reached 'node', along with those that
+// didn't but reached one of its neighbors, since a change to the node may
+// have opened up a way for them to reach it and beyond.  If the node's
+// neighbors can't be had right away, every cached flood that didn't reach
+// it is discarded.
+
+private void flood_invalidate(mixed node) {
+	if(!flood_cache)
+		return;
+	mixed key = flood_key(node);
+	mixed neighbors = 0;
+	int looked = 0;
+	foreach(mixed validate_key, mapping validate_cache : flood_cache)
+		foreach(mixed origin_key : m_indices(validate_cache)) {
+			mixed * flood = validate_cache[origin_key];
+			mapping field = flood[Astar_Flood_Field];
+			int reached = member(field, key);
+			if(!reached) {
+				// Looked up through the flood's own pathfind, but only once, since the rules can't depend on it.
+				if(!looked) {
+					neighbors = flood_neighbors(flood[Astar_Flood_Pathfind], node, 0);
+					looked = 1;
+				}
+				if(!pointerp(neighbors))
+					reached = 1;
+				else
+					foreach(mixed * neighbor : neighbors)
+						if(member(field, flood_key(neighbor[0]))) {
+							reached = 1;
+							break;
+						}
+			}
+			if(reached)
+				map_delete(validate_cache, origin_key);
+		}
+}
+
+// astar_invalidate_node()
+//
+// Invalidates cached paths through 'node', as in astar.c, and cached
+// floods that reached it or its neighbors.  Only flood caching need be on.
+
+void astar_invalidate_node(mixed node) {
+	if(query_astar_targeted_invalidation() || query_astar_neighbor_caching() || !flood_cache)
+		::astar_invalidate_node(node);
+	flood_invalidate(flood_node(node));
+}
+
+// astar_invalidate_edge()
+//
+// Invalidates cached paths using the edge 'edge' from 'from', as in
+// astar.c, and cached floods that reached 'from', since the edge may have
+// been part of their paths, or its neighbors, since it may now lead them
+// to it.  Only flood caching need be on.
+
+void astar_invalidate_edge(mixed from, mixed edge) {
+	if(query_astar_targeted_invalidation() || query_astar_neighbor_caching() || !flood_cache)
+		::astar_invalidate_edge(from, edge);
+	flood_invalidate(flood_node(from));
+}
+
+// astar_build_landmarks()
+//
+// Precomputes the costs from every node within reach to each of 'count'
+// landmarks, for use by astar_landmark_distance().  The nodes in 'nodes'
+// are used as the first landmarks, and at least one must be given, with
+// any given more than once used once; the rest are chosen as the build
+// goes.  Each landmark takes a flood over the whole graph, done via
+// astar_flood(), so the build runs in parts via the scheduling rule,
+// subject to the run limit, and 'callback', if given, is called with the
+// landmark build data structure (see the Astar_Landmark_Build_* macros in
+// astar.h) when it completes; the new landmarks take over from any old
+// ones at that point.  Memory used is one float per landmark per node.  If
+// the graph's costs change, rebuild the landmarks, since bounds from stale
+// costs can overestimate.
+
+varargs void astar_build_landmarks(mixed * nodes, int count, closure callback) {
+	if(!sizeof(nodes))
+		raise_error("Landmark build needs at least one node to start from");
+	nodes = map(nodes, #'flood_node);
+	mapping seen = ([]);
+	mixed * unique = ({});
+	foreach(mixed node : nodes) {
+		mixed key = flood_key(node);
+		if(member(seen, key))
+			continue;
+		seen[key] = 1;
+		unique += ({ node });
+	}
+	nodes = unique;
+	mixed * build = allocate(Astar_Landmark_Build_Fields);
+	build[Astar_Landmark_Build_Landmarks] = nodes;
+	build[Astar_Landmark_Build_Count] = count > sizeof(nodes) ? count : sizeof(nodes);
+	build[Astar_Landmark_Build_Index] = 0;
+	build[Astar_Landmark_Build_Table] = ([]);
+	build[Astar_Landmark_Build_Nodes] = ([]);
+	build[Astar_Landmark_Build_Callback] = callback;
+	build[Astar_Landmark_Build_Pathfind] = astar_pathfind_create(nodes[0], nodes[0], 0, 0, Astar_Pathfind_Control_Flag_Uncache, build);
+	landmark_next(build);
+}
+
+// astar_landmark_distance()
+//
+// A distance rule using the landmarks built by astar_build_landmarks().  It
+// can be set as the distance rule with
+//
+//     set_astar_distance_rule(#'astar_landmark_distance);
+//
+// or called from a distance rule of the instance's own, which might take
+// the larger of its estimate and this one.  By the triangle inequality, the
+// cost from the active node to the target is at least the difference
+// between their costs to any landmark, so the largest of these differences
+// is an estimate that never overestimates, found without any coordinates.
+// If the graph is taken to be symmetric (there is no reverse neighbors
+// rule), the difference counts in either direction.  Returns -1 if there
+// are no landmarks or either node wasn't reached when they were built.
+
+mixed astar_landmark_distance(mixed * pathfind) {
+	if(!landmark_table)
+		return -1;
+	mixed * from = landmark_table[flood_key(pathfind[Astar_Pathfind_Active_Node])];
+	mixed * to = landmark_table[flood_key(pathfind[Astar_Pathfind_To])];
+	if(!from || !to)
+		return -1;
+	int symmetric = !query_astar_reverse_neighbors_rule();
+	float best = 0.0;
+	for(int ix = 0; ix < sizeof(from); ix++) {
+		float a = from[ix];
+		float b = to[ix];
+		if(a < 0.0 || b < 0.0)
+			continue;
+		if(a - b > best)
+			best = a - b;
+		if(symmetric && b - a > best)
+			best = b - a;
+	}
+	return best;
+}
+
+// astar_clear_landmarks()
+//
+// Discards the landmarks built by astar_build_landmarks().
+
+void astar_clear_landmarks() {
+	landmarks = 0;
+	landmark_table = 0;
+}
@@ -0,0 +1,239 @@
+// Grid Search Module
+//
+// Builds on the A* search module to speed up pathfinding on uniform-cost
+// grids, like the one in examples/astar_2d.c, using jump point search.  On
+// such a grid, many paths of equal cost lead between two cells, differing
+// only in the order their moves are made in, and ordinary A* examines all
+// of them.  Jump point search only considers the cells where a path might
+// need to turn -- cells next to obstacles, and the target -- and jumps from
+// one to the next in straight lines, so a pathfind across a large open area
+// deals with a handful of cells rather than all of them.  The paths found
+// cost the same as those ordinary A* would find.
+
+// Usage: inherit this module in place of /mod/algorithm/astar, and
+// configure the A* rules as usual, with nodes that are ({ x, y }) arrays and
+// a node key rule for them.  In addition, set a grid rule with
+// set_astar_grid_rule(), then call astar_grid_find_path() just as you would
+// call astar_find_path().  The neighbors rule is not used for grid
+// pathfinds; the grid description the grid rule returns takes its place.
+// For 8-connected grids, a distance rule giving the octile distance,
+//
+//     max(dx, dy) + (diagonal cost - 1.0) * min(dx, dy)
+//
+// gives the best results.
+//
+// Paths found hold every cell along the way, with edges that are
+// ({ dx, dy }) offsets, as the neighbors rule in examples/astar_2d.c gives.
+// While the pathfind is under way, though, the nodes worked with are only
+// the cells jumped between, and the edges reaching them are ({ dx, dy,
+// count }) arrays, for a jump of 'count' moves of ({ dx, dy }); 'validate'
+// and the completion rule only see these cells, so checks that must apply
+// to every cell belong in the grid description's passability test.
+// Diagonal moves are only allowed between cells whose two shared
+// neighbors are both passable, so paths never cut corners.
+
+#include <astar.h>
+
+inherit "/mod/algorithm/astar";
+
+// SECTION: Instance configuration
+
+// Grid rule
+//
+// The grid rule describes the grid to search.  It is called with the
+// pathfind data structure as argument when a grid pathfind starts, and
+// should return a grid description as defined by the Astar_Grid_* macros in
+// astar.h, or 0 if the pathfind isn't on a grid it can describe, in which
+// case the pathfind is done by astar_find_path().
+
+private closure grid_rule;
+
+void set_astar_grid_rule(closure val) {
+	grid_rule = val;
+}
+
+closure query_astar_grid_rule() {
+	return grid_rule;
+}
+
+// SECTION: Internal support functions
+
+// grid_passable()
+//
+// Determines whether a cell is on the grid and can be entered.
+
+private int grid_passable(mixed * grid, mixed * pathfind, int x, int y) {
+	if(x < grid[Astar_Grid_Min_X] || x > grid[Astar_Grid_Max_X] || y < grid[Astar_Grid_Min_Y] || y > grid[Astar_Grid_Max_Y])
+		return 0;
+	return funcall(grid[Astar_Grid_Passable], x, y, pathfind) && 1;
+}
+
+// grid_jump()
+//
+// Moves from cell x, y in the direction dx, dy until reaching a cell a path
+// might need to turn at, returning it as an ({ x, y }) node, or 0 if the
+// way is blocked first.  Diagonal jumps stop at cells from which a jump
+// along either axis finds such a cell, as do vertical jumps on 4-connected
+// grids with horizontal jumps.
+
+private int * grid_jump(mixed * grid, mixed * pathfind, int x, int y, int dx, int dy) {
+	int * goal = pathfind[Astar_Pathfind_To];
+	int eight = grid[Astar_Grid_Connectivity] == 8;
+	for(;;) {
+		if(!grid_passable(grid, pathfind, x, y))
+			return 0;
+		if(x == goal[0] && y == goal[1])
+			return ({ x, y });
+		if(dx && dy) {
+			if(grid_jump(grid, pathfind, x + dx, y, dx, 0) || grid_jump(grid, pathfind, x, y + dy, 0, dy))
+				return ({ x, y });
+		} else if(dx) {
+			// A cell beside us that we couldn't have reached more directly by way of the cell behind us
+			if((grid_passable(grid, pathfind, x, y - 1) && !grid_passable(grid, pathfind, x - dx, y - 1)) ||
+				(grid_passable(grid, pathfind, x, y + 1) && !grid_passable(grid, pathfind, x - dx, y + 1)))
+				return ({ x, y });
+		} else {
+			if((grid_passable(grid, pathfind, x - 1, y) && !grid_passable(grid, pathfind, x - 1, y - dy)) ||
+				(grid_passable(grid, pathfind, x + 1, y) && !grid_passable(grid, pathfind, x + 1, y - dy)))
+				return ({ x, y });
+			if(!eight && (grid_jump(grid, pathfind, x + 1, y, 1, 0) || grid_jump(grid, pathfind, x - 1, y, -1, 0)))
+				return ({ x, y });
+		}
+		// Diagonal moves can't cut corners.
+		if(dx && dy && !(grid_passable(grid, pathfind, x + dx, y) && grid_passable(grid, pathfind, x, y + dy)))
+			return 0;
+		x += dx;
+		y += dy;
+	}
+}
+
+// grid_directions()
+//
+// Returns the directions worth jumping in from a cell reached moving in
+// direction dx, dy, or all of the directions available if dx and dy are
+// both 0, as ({ dx, dy }) arrays.  These are the natural neighbors, those
+// a path arriving this way might go on to without any shorter way around
+// the cell, and the forced neighbors, those only worth turning toward
+// because an obstacle kept the path from reaching them more directly: a
+// cell beside us is forced when the cell behind it, beside the cell we
+// came from, is blocked.
+
+private mixed * grid_directions(mixed * grid, mixed * pathfind, int x, int y, int dx, int dy) {
+	int eight = grid[Astar_Grid_Connectivity] == 8;
+	mixed * out = ({});
+	if(!dx && !dy) {
+		foreach(int * direction : ({ ({ 1, 0 }), ({ -1, 0 }), ({ 0, 1 }), ({ 0, -1 }) }))
+			if(grid_passable(grid, pathfind, x + direction[0], y + direction[1]))
+				out += ({ direction });
+		if(eight)
+			foreach(int ddx : ({ 1, -1 }))
+				foreach(int ddy : ({ 1, -1 }))
+					if(grid_passable(grid, pathfind, x + ddx, y) && grid_passable(grid, pathfind, x, y + ddy) && grid_passable(grid, pathfind, x + ddx, y + ddy))
+						out += ({ ({ ddx, ddy }) });
+		return out;
+	}
+	if(dx && dy) {
+		int horizontal = grid_passable(grid, pathfind, x + dx, y);
+		int vertical = grid_passable(grid, pathfind, x, y + dy);
+		if(vertical)
+			out += ({ ({ 0, dy }) });
+		if(horizontal)
+			out += ({ ({ dx, 0 }) });
+		if(horizontal && vertical && grid_passable(grid, pathfind, x + dx, y + dy))
+			out += ({ ({ dx, dy }) });
+		return out;
+	}
+	// Moving along an axis: onward, and to each side that is forced, along with the diagonal between onward and that
+	// side on 8-connected grids.  On 4-connected grids, vertical jumps stop wherever a horizontal jump would find
+	// something, so both sides are natural neighbors there.
+	int ax = dy ? 1 : 0;
+	int ay = dx ? 1 : 0;
+	int next = grid_passable(grid, pathfind, x + dx, y + dy);
+	if(next)
+		out += ({ ({ dx, dy }) });
+	foreach(int side : ({ 1, -1 })) {
+		int sx = side * ax;
+		int sy = side * ay;
+		if(!grid_passable(grid, pathfind, x + sx, y + sy))
+			continue;
+		if((eight || dx) && grid_passable(grid, pathfind, x - dx + sx, y - dy + sy))
+			continue;
+		out += ({ ({ sx, sy }) });
+		if(eight && next && grid_passable(grid, pathfind, x + dx + sx, y + dy + sy))
+			out += ({ ({ dx + sx, dy + sy }) });
+	}
+	return out;
+}
+
+// astar_grid_neighbors()
+//
+// Neighbors rule for grid pathfinds; gives the cells that can be jumped to
+// from the active node.
+
+private mixed * astar_grid_neighbors(mixed * pathfind) {
+	mixed * grid = pathfind[Astar_Pathfind_Grid];
+	int * node = pathfind[Astar_Pathfind_Active_Node];
+	mixed * edge = pathfind[Astar_Pathfind_Active_Edge];
+	float diagonal = grid[Astar_Grid_Diagonal_Cost] || sqrt(2.0);
+	mixed * out = ({});
+	foreach(int * direction : grid_directions(grid, pathfind, node[0], node[1], edge ? edge[0] : 0, edge ? edge[1] : 0)) {
+		int * jump = grid_jump(grid, pathfind, node[0] + direction[0], node[1] + direction[1], direction[0], direction[1]);
+		if(!jump)
+			continue;
+		int count = abs(jump[0] - node[0]);
+		if(abs(jump[1] - node[1]) > count)
+			count = abs(jump[1] - node[1]);
+		out += ({ ({ jump, ({ direction[0], direction[1], count }), count * (direction[0] && direction[1] ? diagonal : 1.0) }) });
+	}
+	return out;
+}
+
+// astar_grid_fill()
+//
+// Result rule for grid pathfinds; fills in the cells between the cells
+// jumped between.
+
+private mixed * astar_grid_fill(mixed * pathfind, mixed * path) {
+	int * node = path[Astar_Path_Nodes][0];
+	mixed * nodes = ({ node });
+	mixed * edges = ({});
+	foreach(int * jump : path[Astar_Path_Edges])
+		for(int ix = 0; ix < jump[2]; ix++) {
+			node = ({ node[0] + jump[0], node[1] + jump[1] });
+			nodes += ({ node });
+			edges += ({ ({ jump[0], jump[1] }) });
+		}
+	mixed * out = allocate(Astar_Path_Fields);
+	out[Astar_Path_Nodes] = nodes;
+	out[Astar_Path_Edges] = edges;
+	out[Astar_Path_Distance] = path[Astar_Path_Distance];
+	out[Astar_Path_Cost] = path[Astar_Path_Cost];
+	return out;
+}
+
+// SECTION: Operational interface
+
+// astar_grid_find_path()
+//
+// Performs pathfinding on the grid described by the grid rule, using jump
+// point search; the arguments and return value are the same as for
+// astar_find_path().  Requests the grid rule can't describe a grid for,
+// and all requests if there is no grid rule, are passed along to
+// astar_find_path().  Results are cached as those of astar_find_path() are,
+// if caching is on.  Grid pathfinds can't be bidirectional, since jumps
+// can't be followed backward.
+
+varargs mixed * astar_grid_find_path(mixed from, mixed to, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline, float weight) {
+	if(grid_rule && (control_flags & Astar_Pathfind_Control_Flag_Bidirectional))
+		raise_error("Grid pathfinding can't be bidirectional");
+	if(!grid_rule)
+		return astar_find_path(from, to, validate, callback, control_flags, extra, priority, deadline, weight);
+	mixed * pathfind = astar_pathfind_create(from, to, validate, callback, control_flags, extra, priority, deadline, weight);
+	mixed * grid = funcall(grid_rule, pathfind);
+	if(!grid)
+		return astar_find_path(from, to, validate, callback, control_flags, extra, priority, deadline, weight);
+	pathfind[Astar_Pathfind_Grid] = grid;
+	pathfind[Astar_Pathfind_Neighbors_Rule] = #'astar_grid_neighbors;
+	pathfind[Astar_Pathfind_Result_Rule] = #'astar_grid_fill;
+	return astar_pathfind_start(pathfind);
+}
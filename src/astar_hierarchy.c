@@ -0,0 +1,401 @@
+// Hierarchical A* Search Module
+//
+// Builds on the A* search module to speed up pathfinding across large
+// graphs, in the manner of HPA* (hierarchical pathfinding A*).  The graph
+// is divided into clusters of nodes, such as the rooms of a MUD area or
+// the cells of a region of a coordinate space.  Nodes at cluster borders
+// that have edges leading into other clusters are the cluster's entrances.
+// Paths between each pair of entrances to a cluster are found ahead of
+// time, and together with the edges between clusters they make up a much
+// smaller abstract graph.  Requests for paths between clusters are then
+// answered by searching the abstract graph, after which the stored paths
+// the abstract path is made of are joined into the final path.
+//
+// This is the same as searching the problem space made up of A* results,
+// as described in astar.c, but done for you: most of the work of a long
+// pathfind is done once, when the abstract graph is built, rather than
+// for every request.  Paths found this way are not always the very best
+// paths, since they are made to pass through cluster entrances, but they
+// are generally close.
+
+// Usage: inherit this module in place of /mod/algorithm/astar, and
+// configure the A* rules as usual; everything from astar.c is available.
+// In addition, set a cluster key rule with set_astar_cluster_key_rule(),
+// then call astar_build_hierarchy() with one or more nodes from which the
+// whole graph can be reached.  The build discovers the graph using the
+// neighbors rule and runs in parts via the scheduling rule, subject to the
+// run limit rule, so it can be done from create() without stalling.  Once
+// it has completed, astar_hierarchy_find_path() can be called just as you
+// would call astar_find_path().
+//
+// If your graph changes, call astar_clear_hierarchy() and rebuild it.
+
+#include <astar.h>
+
+inherit "/mod/algorithm/astar";
+
+// SECTION: Instance configuration
+
+// Cluster key rule
+//
+// The cluster key rule is used to determine which cluster a node belongs
+// to.  It is called with a node as argument, and should return a value
+// usable as a mapping key, usually a string or int, that is the same for
+// all the nodes in a cluster; a MUD area's directory name, for instance,
+// or a node's coordinates divided by some cluster size.  Clusters work best
+// when they are connected internally and have a fairly small number of
+// entrances.
+
+private closure cluster_key_rule;
+
+void set_astar_cluster_key_rule(closure val) {
+	cluster_key_rule = val;
+}
+
+closure query_astar_cluster_key_rule() {
+	return cluster_key_rule;
+}
+
+// The abstract graph, once built: a mapping of cluster keys to mappings of
+// entrance node keys to entrance nodes, and a mapping of node keys to the
+// links leaving them.
+
+private mapping hierarchy_entrances;
+private mapping hierarchy_links;
+
+mapping query_astar_hierarchy() {
+	return hierarchy_links;
+}
+
+// SECTION: Internal support functions
+
+// hierarchy_key()
+//
+// Node key retrieval, as done by the A* module.
+
+private mixed hierarchy_key(mixed node) {
+	return astar_node_key(node);
+}
+
+// hierarchy_segment()
+//
+// Creates the A* path data structure for a single edge between nodes.
+
+private mixed * hierarchy_segment(mixed from, mixed to, mixed edge, mixed cost) {
+	mixed * path = allocate(Astar_Path_Fields);
+	path[Astar_Path_Nodes] = ({ from, to });
+	path[Astar_Path_Edges] = ({ edge });
+	path[Astar_Path_Distance] = 0.0;
+	path[Astar_Path_Cost] = cost;
+	return path;
+}
+
+// hierarchy_neighbors()
+//
+// Retrieves the neighbors of a node using the instance's neighbors rule,
+// or its batch neighbors rule if that is what it has, with 'pathfind' set
+// up as for a pathfind at the beginning of a path.
+
+private mixed hierarchy_neighbors(mixed * pathfind, mixed node) {
+	pathfind[Astar_Pathfind_Active_Node] = node;
+	pathfind[Astar_Pathfind_Active_Edge] = 0;
+	if(query_astar_rule_dependencies() & Astar_Rule_Dependency_Active_Path) {
+		mixed * path = allocate(Astar_Path_Fields);
+		path[Astar_Path_Nodes] = ({ node });
+		path[Astar_Path_Edges] = ({});
+		path[Astar_Path_Distance] = 0.0;
+		path[Astar_Path_Cost] = 0.0;
+		pathfind[Astar_Pathfind_Active_Path] = path;
+	}
+	closure rule = query_astar_neighbors_rule();
+	if(rule)
+		return funcall(rule, pathfind);
+	pathfind[Astar_Pathfind_Active_Nodes] = ({ node });
+	pathfind[Astar_Pathfind_Active_Edges] = ({ 0 });
+	mixed out = funcall(query_astar_batch_neighbors_rule(), pathfind);
+	pathfind[Astar_Pathfind_Active_Nodes] = 0;
+	pathfind[Astar_Pathfind_Active_Edges] = 0;
+	return pointerp(out) ? out[0] : out;
+}
+
+// astar_hierarchy_cluster_validate()
+//
+// Validation rule for paths within a cluster; the cluster key is carried
+// in the pathfind's 'extra' value.
+
+private int astar_hierarchy_cluster_validate(mixed * pathfind) {
+	return funcall(cluster_key_rule, pathfind[Astar_Pathfind_Active_Node]) == pathfind[Astar_Pathfind_Extra];
+}
+
+// hierarchy_cluster_path()
+//
+// Finds a path between two nodes without leaving the given cluster.
+// Returns the path, 0 if there is none, or Astar_Result_Cut_Off if the
+// run limit was reached.  The iterations of the pathfind are counted in
+// the current cycle of 'charge', the pathfind it is done on behalf of.
+
+private mixed hierarchy_cluster_path(mixed from, mixed to, mixed cluster, mixed * charge) {
+	mixed * pathfind = astar_find_path(from, to, #'astar_hierarchy_cluster_validate, 0, Astar_Pathfind_Control_Flag_Uncache | Astar_Pathfind_Control_Flag_No_Continue, cluster);
+	charge[Astar_Pathfind_Cycle_Iterations] += pathfind[Astar_Pathfind_Cycle_Iterations];
+	mixed result = pathfind[Astar_Pathfind_Result];
+	if(pointerp(result))
+		return result;
+	if(result == Astar_Result_Cut_Off || result == Astar_Result_Cannot_Continue)
+		return Astar_Result_Cut_Off;
+	return 0;
+}
+
+// hierarchy_link()
+//
+// Creates an abstract graph link, in the form of a neighbors rule result
+// entry, standing for a path.
+
+private mixed * hierarchy_link(mixed * path) {
+	return ({ path[Astar_Path_Nodes][<1], path, path[Astar_Path_Cost] - path[Astar_Path_Distance] });
+}
+
+private void astar_hierarchy_build_step(mixed * build);
+
+// hierarchy_build_continue()
+//
+// Schedules the continuation of a build via the scheduling rule.
+
+private void hierarchy_build_continue(mixed * build) {
+	funcall(query_astar_scheduling_rule() || #'call_out, #'astar_hierarchy_build_step, 2, build);
+}
+
+// astar_hierarchy_build_step()
+//
+// Performs the work of building the abstract graph; takes a build data
+// structure as argument, and can resume from any point in the build.  The
+// nodes reachable from the seed nodes are discovered first, noting the
+// edges that cross cluster borders, and then paths are found between each
+// pair of entrances to each cluster.
+
+private void astar_hierarchy_build_step(mixed * build) {
+	mixed * pathfind = build[Astar_Hierarchy_Build_Pathfind];
+	astar_cycle_begin(pathfind);
+	mapping entrances = build[Astar_Hierarchy_Build_Entrances];
+	mapping links = build[Astar_Hierarchy_Build_Links];
+	// Discover the graph.
+	mixed * queue = build[Astar_Hierarchy_Build_Queue];
+	while(build[Astar_Hierarchy_Build_Queue_Index] < build[Astar_Hierarchy_Build_Queue_Count]) {
+		if(pathfind[Astar_Pathfind_Cycle_Iterations]++ && astar_run_limit_reached(pathfind))
+			return hierarchy_build_continue(build);
+		mixed node = queue[build[Astar_Hierarchy_Build_Queue_Index]];
+		mixed neighbors = hierarchy_neighbors(pathfind, node);
+		if(neighbors == Astar_Result_Processing)
+			return hierarchy_build_continue(build);
+		if(!pointerp(neighbors))
+			raise_error("Invalid return value from neighbors rule");
+		build[Astar_Hierarchy_Build_Queue_Index]++;
+		mixed node_key = hierarchy_key(node);
+		mixed cluster = funcall(cluster_key_rule, node);
+		foreach(mixed * neighbor : neighbors) {
+			mixed key = hierarchy_key(neighbor[0]);
+			if(!build[Astar_Hierarchy_Build_Seen][key]) {
+				build[Astar_Hierarchy_Build_Seen][key] = 1;
+				int ix = build[Astar_Hierarchy_Build_Queue_Count]++;
+				if(ix >= sizeof(queue)) {
+					queue += allocate(sizeof(queue) || 1);
+					build[Astar_Hierarchy_Build_Queue] = queue;
+				}
+				queue[ix] = neighbor[0];
+			}
+			// An edge into another cluster makes entrances of the nodes at both ends, and is a link in its own right.
+			mixed neighbor_cluster = funcall(cluster_key_rule, neighbor[0]);
+			if(neighbor_cluster == cluster)
+				continue;
+			mapping cluster_entrances = entrances[cluster] ||= ([]);
+			cluster_entrances[node_key] = node;
+			cluster_entrances = entrances[neighbor_cluster] ||= ([]);
+			cluster_entrances[key] = neighbor[0];
+			links[node_key] = (links[node_key] || ({})) + ({ hierarchy_link(hierarchy_segment(node, neighbor[0], neighbor[1], neighbor[2])) });
+		}
+	}
+	// Once the graph is discovered, list the pairs of entrances to each cluster.
+	if(!build[Astar_Hierarchy_Build_Pairs]) {
+		mixed * pairs = ({});
+		foreach(mixed cluster, mapping cluster_entrances : entrances) {
+			mixed * nodes = m_values(cluster_entrances);
+			foreach(mixed from : nodes)
+				foreach(mixed to : nodes)
+					if(from != to)
+						pairs += ({ ({ from, to, cluster }) });
+		}
+		build[Astar_Hierarchy_Build_Pairs] = pairs;
+		build[Astar_Hierarchy_Build_Pair_Index] = 0;
+	}
+	// Find the paths between entrances within their cluster.
+	mixed * pairs = build[Astar_Hierarchy_Build_Pairs];
+	while(build[Astar_Hierarchy_Build_Pair_Index] < sizeof(pairs)) {
+		int first = !pathfind[Astar_Pathfind_Cycle_Iterations]++;
+		if(!first && astar_run_limit_reached(pathfind))
+			return hierarchy_build_continue(build);
+		mixed * pair = pairs[build[Astar_Hierarchy_Build_Pair_Index]];
+		mixed path = hierarchy_cluster_path(pair[0], pair[1], pair[2], pathfind);
+		// A pathfind cut off partway through a cycle is tried again in the next one, but if it can't finish within a
+		// whole cycle, it never will, and we do without it.
+		if(path == Astar_Result_Cut_Off && !first)
+			return hierarchy_build_continue(build);
+		build[Astar_Hierarchy_Build_Pair_Index]++;
+		if(pointerp(path)) {
+			mixed from_key = hierarchy_key(pair[0]);
+			links[from_key] = (links[from_key] || ({})) + ({ hierarchy_link(path) });
+		}
+	}
+	// All done; the new abstract graph goes into service.
+	hierarchy_entrances = entrances;
+	hierarchy_links = links;
+	if(build[Astar_Hierarchy_Build_Callback])
+		funcall(build[Astar_Hierarchy_Build_Callback], build);
+}
+
+// hierarchy_connect()
+//
+// Links the starting or target node of a search over the abstract graph
+// with the entrance of its cluster with node key 'entrance_key', returning
+// the path between 'from' and 'to' as hierarchy_cluster_path() does.  Paths
+// found are kept with the pathfind, so that an expansion suspended partway
+// through doesn't look for them again, and their iterations count against
+// its run limit, so that after the first path looked for in a cycle, the
+// next is only looked for if the limit hasn't been reached.  The first
+// path of a cycle has had a cycle of its own, and would do no better the
+// next time if it were cut off, so the link goes without it.
+
+private mixed hierarchy_connect(mixed * pathfind, mixed entrance_key, mixed from, mixed to, mixed cluster) {
+	mapping paths = pathfind[Astar_Pathfind_Hierarchy_Paths] ||= ([]);
+	if(member(paths, entrance_key))
+		return paths[entrance_key];
+	int first = pathfind[Astar_Pathfind_Hierarchy_Cycle] != pathfind[Astar_Pathfind_Cycle_Index];
+	if(!first && astar_run_limit_reached(pathfind))
+		return Astar_Result_Cut_Off;
+	pathfind[Astar_Pathfind_Hierarchy_Cycle] = pathfind[Astar_Pathfind_Cycle_Index];
+	mixed path = hierarchy_cluster_path(from, to, cluster, pathfind);
+	if(path == Astar_Result_Cut_Off) {
+		if(!first)
+			return path;
+		path = 0;
+	}
+	return paths[entrance_key] = path;
+}
+
+// astar_hierarchy_neighbors()
+//
+// Neighbors rule for searching the abstract graph.  Besides the links
+// stored in the abstract graph, the starting node of a request is linked
+// to the entrances of its cluster, and the entrances of the target node's
+// cluster are linked to the target node, by finding paths within those
+// clusters as the nodes are reached.
+
+private mixed astar_hierarchy_neighbors(mixed * pathfind) {
+	mixed node = pathfind[Astar_Pathfind_Active_Node];
+	mixed key = hierarchy_key(node);
+	mixed * out = hierarchy_links[key] || ({});
+	mixed cluster = funcall(cluster_key_rule, node);
+	mixed to = pathfind[Astar_Pathfind_To];
+	mixed to_key = hierarchy_key(to);
+	mapping cluster_entrances = hierarchy_entrances[cluster] || ([]);
+	if(key == hierarchy_key(pathfind[Astar_Pathfind_From]) && !member(cluster_entrances, key)) {
+		foreach(mixed entrance_key, mixed entrance : cluster_entrances) {
+			mixed path = hierarchy_connect(pathfind, entrance_key, node, entrance, cluster);
+			if(path == Astar_Result_Cut_Off)
+				return Astar_Result_Processing;
+			if(path)
+				out += ({ hierarchy_link(path) });
+		}
+	}
+	if(key != to_key && member(cluster_entrances, key) && cluster == funcall(cluster_key_rule, to) && !member(cluster_entrances, to_key)) {
+		mixed path = hierarchy_connect(pathfind, key, node, to, cluster);
+		if(path == Astar_Result_Cut_Off)
+			return Astar_Result_Processing;
+		if(path)
+			out += ({ hierarchy_link(path) });
+	}
+	return out;
+}
+
+// astar_hierarchy_refine()
+//
+// Result rule for searching the abstract graph; joins the paths standing
+// behind the abstract path's links into the full path.
+
+private mixed * astar_hierarchy_refine(mixed * pathfind, mixed * abstract) {
+	mixed * nodes = abstract[Astar_Path_Nodes][0 .. 0];
+	mixed * edges = ({});
+	foreach(mixed * segment : abstract[Astar_Path_Edges]) {
+		nodes += segment[Astar_Path_Nodes][1 ..];
+		edges += segment[Astar_Path_Edges];
+	}
+	mixed * path = allocate(Astar_Path_Fields);
+	path[Astar_Path_Nodes] = nodes;
+	path[Astar_Path_Edges] = edges;
+	path[Astar_Path_Distance] = abstract[Astar_Path_Distance];
+	path[Astar_Path_Cost] = abstract[Astar_Path_Cost];
+	return path;
+}
+
+// SECTION: Operational interface
+
+// astar_build_hierarchy()
+//
+// Builds the abstract graph, discovering the graph by way of the neighbors
+// rule starting from the nodes in 'seeds'.  The build continues via the
+// scheduling rule whenever the run limit rule says to, and the abstract
+// graph goes into use when it is complete, at which point 'callback', if
+// given, is called with the build data structure (see the
+// Astar_Hierarchy_Build_* macros in astar.h) as argument.  Until then, any
+// abstract graph from a previous build remains in use.  The return value
+// is the build data structure.
+
+varargs mixed * astar_build_hierarchy(mixed * seeds, closure callback) {
+	if(!cluster_key_rule)
+		raise_error("astar_build_hierarchy() called with no cluster key rule");
+	closure node_rule = query_astar_node_rule();
+	if(node_rule)
+		seeds = map(seeds, node_rule);
+	mixed * build = allocate(Astar_Hierarchy_Build_Fields);
+	build[Astar_Hierarchy_Build_Queue] = seeds;
+	build[Astar_Hierarchy_Build_Queue_Index] = 0;
+	build[Astar_Hierarchy_Build_Queue_Count] = sizeof(seeds);
+	build[Astar_Hierarchy_Build_Seen] = mkmapping(map(seeds, #'hierarchy_key), allocate(sizeof(seeds), 1));
+	build[Astar_Hierarchy_Build_Entrances] = ([]);
+	build[Astar_Hierarchy_Build_Links] = ([]);
+	build[Astar_Hierarchy_Build_Callback] = callback;
+	build[Astar_Hierarchy_Build_Pathfind] = astar_pathfind_create(seeds[0], seeds[0], 0, 0, Astar_Pathfind_Control_Flag_Uncache, build);
+	astar_hierarchy_build_step(build);
+	return build;
+}
+
+// astar_clear_hierarchy()
+//
+// Discards the abstract graph, so that astar_hierarchy_find_path() behaves
+// like astar_find_path() until it is built again.
+
+void astar_clear_hierarchy() {
+	hierarchy_entrances = 0;
+	hierarchy_links = 0;
+}
+
+// astar_hierarchy_find_path()
+//
+// Performs pathfinding using the abstract graph; the arguments and return
+// value are the same as for astar_find_path().  Requests that the abstract
+// graph can't help with -- those made before it is built, those between
+// nodes in the same cluster, and those with a 'validate' closure, which
+// the stored paths can't take into account -- are passed along to
+// astar_find_path().  A completion rule, if the instance has one, is
+// only checked against the nodes of the abstract graph.  Results of the
+// search over the abstract graph are neither cached nor looked up in the
+// cache; only the requests passed along to astar_find_path() use it.
+
+varargs mixed * astar_hierarchy_find_path(mixed from, mixed to, closure validate, closure callback, int control_flags, mixed extra, int priority, int deadline, float weight) {
+	if(!hierarchy_links || validate)
+		return astar_find_path(from, to, validate, callback, control_flags, extra, priority, deadline, weight);
+	mixed * pathfind = astar_pathfind_create(from, to, validate, callback, control_flags | Astar_Pathfind_Control_Flag_Uncache, extra, priority, deadline, weight);
+	if(funcall(cluster_key_rule, pathfind[Astar_Pathfind_From]) == funcall(cluster_key_rule, pathfind[Astar_Pathfind_To]))
+		return astar_find_path(from, to, validate, callback, control_flags, extra, priority, deadline, weight);
+	pathfind[Astar_Pathfind_Neighbors_Rule] = #'astar_hierarchy_neighbors;
+	pathfind[Astar_Pathfind_Result_Rule] = #'astar_hierarchy_refine;
+	return astar_pathfind_start(pathfind);
+}
@@ -0,0 +1,182 @@
+// A* Search Metrics Daemon
+//
+// Keeps totals of the pathfinding done by every object using the A* search
+// module, so the cost of pathfinding can be looked at across a whole game
+// rather than one instance at a time.  Each pathfind reports here when it
+// finishes; the daemon keeps, for each program, the number of pathfinds,
+// their results, cycles, wall time, cache hits and misses, and paths
+// expanded, along with a log of the slowest pathfinds seen, which is handy
+// for finding the instances that use up your time budget.  Totals are kept
+// by load_name(), so the clones of a blueprint share one record and the
+// daemon doesn't grow with every clone that ever pathfinds; the slow
+// pathfind log names the individual objects.
+//
+// Usage: place this file where Astar_Metrics_Daemon in astar.h points,
+// /mod/algorithm/astar_metrics by default.  Nothing needs to be done in the
+// objects using the module.  query_astar_metrics() and
+// query_astar_slow_pathfinds() retrieve what has been collected, and
+// astar_metrics_reset() starts over.
+
+#include <astar.h>
+
+// A mapping of load names to Astar_Metrics_* structures.
+
+private mapping metrics = ([]);
+
+// The slow pathfind log: up to slow_log_size Astar_Slow_Pathfind_*
+// structures, in no particular order, with slow_log_floor the position of
+// the fastest of them, which is the one replaced when a slower pathfind
+// comes along and the log is full.
+
+private mixed * slow_log = ({});
+private int slow_log_floor;
+private int slow_log_size = Astar_Metrics_Default_Slow_Log_Size;
+
+mixed * query_astar_slow_pathfinds();
+
+// SECTION: Configuration
+
+// Slow log size
+//
+// The number of pathfinds kept in the slow pathfind log.  Making it smaller
+// drops the fastest of the pathfinds beyond the new size.
+
+void set_astar_metrics_slow_log_size(int val) {
+	slow_log_size = val;
+	if(sizeof(slow_log) > val)
+		slow_log = query_astar_slow_pathfinds()[0 .. val - 1];
+	slow_log_floor = 0;
+	for(int ix = 1; ix < sizeof(slow_log); ix++)
+		if(slow_log[ix][Astar_Slow_Pathfind_Time] < slow_log[slow_log_floor][Astar_Slow_Pathfind_Time])
+			slow_log_floor = ix;
+}
+
+int query_astar_metrics_slow_log_size() {
+	return slow_log_size;
+}
+
+// SECTION: Internal support functions
+
+// metrics_elapsed()
+//
+// Returns the number of microseconds since 'since', a utime() value.
+
+private int metrics_elapsed(int * since) {
+	int * now = utime();
+	return (now[0] - since[0]) * 1000000 + now[1] - since[1];
+}
+
+// metrics_slow_sort()
+//
+// Sorting function for the slow pathfind log; sorts slow pathfinds to the
+// start of the list.
+
+private int metrics_slow_sort(mixed * a, mixed * b) {
+	return a[Astar_Slow_Pathfind_Time] < b[Astar_Slow_Pathfind_Time];
+}
+
+// metrics_log_slow()
+//
+// Adds a pathfind to the slow pathfind log if the log has room or the
+// pathfind is slower than the fastest of those in it.
+
+private void metrics_log_slow(mixed * entry) {
+	if(sizeof(slow_log) < slow_log_size) {
+		slow_log += ({ entry });
+		if(sizeof(slow_log) == 1 || entry[Astar_Slow_Pathfind_Time] < slow_log[slow_log_floor][Astar_Slow_Pathfind_Time])
+			slow_log_floor = sizeof(slow_log) - 1;
+		return;
+	}
+	if(!slow_log_size || entry[Astar_Slow_Pathfind_Time] <= slow_log[slow_log_floor][Astar_Slow_Pathfind_Time])
+		return;
+	slow_log[slow_log_floor] = entry;
+	for(int ix = 0; ix < sizeof(slow_log); ix++)
+		if(slow_log[ix][Astar_Slow_Pathfind_Time] < slow_log[slow_log_floor][Astar_Slow_Pathfind_Time])
+			slow_log_floor = ix;
+}
+
+// SECTION: Operational interface
+
+// astar_metrics_report()
+//
+// Called by the A* module, in the object that did the pathfind, when a
+// pathfind finishes; 'from_key' and 'to_key' are the node keys of its
+// starting and target nodes.
+
+void astar_metrics_report(mixed * pathfind, mixed from_key, mixed to_key) {
+	string name = load_name(previous_object());
+	mixed * record = metrics[name];
+	if(!record) {
+		record = allocate(Astar_Metrics_Fields);
+		record[Astar_Metrics_Results] = ([]);
+		metrics[name] = record;
+	}
+	mixed result = pathfind[Astar_Pathfind_Result];
+	if(pointerp(result))
+		result = 0;
+	int elapsed = metrics_elapsed(pathfind[Astar_Pathfind_Start_Time]);
+	record[Astar_Metrics_Pathfinds]++;
+	record[Astar_Metrics_Results][result]++;
+	record[Astar_Metrics_Cycles] += pathfind[Astar_Pathfind_Cycle_Index];
+	record[Astar_Metrics_Time] += elapsed;
+	record[Astar_Metrics_Cache_Hits] += pathfind[Astar_Pathfind_Stats_Cache_Hits];
+	record[Astar_Metrics_Cache_Misses] += pathfind[Astar_Pathfind_Stats_Cache_Misses];
+	record[Astar_Metrics_Expanded] += pathfind[Astar_Pathfind_Stats_Expanded];
+	mixed * entry = allocate(Astar_Slow_Pathfind_Fields);
+	entry[Astar_Slow_Pathfind_Object] = object_name(previous_object());
+	entry[Astar_Slow_Pathfind_From_Key] = from_key;
+	entry[Astar_Slow_Pathfind_To_Key] = to_key;
+	entry[Astar_Slow_Pathfind_Time] = elapsed;
+	entry[Astar_Slow_Pathfind_Cycles] = pathfind[Astar_Pathfind_Cycle_Index];
+	entry[Astar_Slow_Pathfind_Result] = result;
+	entry[Astar_Slow_Pathfind_Timestamp] = time();
+	metrics_log_slow(entry);
+}
+
+// query_astar_metrics()
+//
+// Returns the mapping of load names to Astar_Metrics_* structures, or, if
+// 'name' is given, the structure for that object's program alone.
+
+varargs mixed query_astar_metrics(string name) {
+	return name ? metrics[load_name(name)] : metrics;
+}
+
+// query_astar_cache_hit_rate()
+//
+// Returns the fraction of cache lookups that have found a path (or a record
+// of impossibility), for the program of the object named 'name', or for all
+// objects if no name is given.  Returns -1.0 if there have been no lookups.
+
+varargs float query_astar_cache_hit_rate(string name) {
+	if(name)
+		name = load_name(name);
+	int hits = 0;
+	int misses = 0;
+	foreach(string key, mixed * record : metrics)
+		if(!name || key == name) {
+			hits += record[Astar_Metrics_Cache_Hits];
+			misses += record[Astar_Metrics_Cache_Misses];
+		}
+	if(!(hits + misses))
+		return -1.0;
+	return to_float(hits) / (hits + misses);
+}
+
+// query_astar_slow_pathfinds()
+//
+// Returns the slow pathfind log, slowest first.
+
+mixed * query_astar_slow_pathfinds() {
+	return sort_array(slow_log, #'metrics_slow_sort);
+}
+
+// astar_metrics_reset()
+//
+// Discards everything collected so far.
+
+void astar_metrics_reset() {
+	metrics = ([]);
+	slow_log = ({});
+	slow_log_floor = 0;
+}
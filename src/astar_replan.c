@@ -0,0 +1,479 @@
+// Incremental Replanning Module
+//
+// Builds on the A* search module to keep a search around between requests,
+// in the manner of D* Lite, so that an agent moving through a graph that is
+// changing around it can have its path repaired rather than found again
+// from scratch each time it moves or something changes.  The search runs
+// backward from the goal, remembering for each node it has dealt with the
+// cost of the best path from there to the goal; when edges change, only the
+// nodes whose costs depend on them are revisited, and when the agent moves,
+// the costs already found still hold.  Repeated replans then cost roughly
+// in proportion to what has changed rather than to the whole search space.
+
+// Usage: inherit this module in place of /mod/algorithm/astar, and
+// configure the A* rules as usual.  Then:
+//
+//     mixed * search = astar_open_search(start, goal);
+//     mixed path = astar_replan(search);
+//
+// and as the agent moves and the graph changes:
+//
+//     astar_move_start(search, where_the_agent_is_now);
+//     astar_update_edge(search, from, to, new_cost);
+//     path = astar_replan(search);
+//
+// The search is worked backward from the goal, so when the instance's rules
+// are called for it, pathfind[Astar_Pathfind_From] is the goal and
+// pathfind[Astar_Pathfind_To] is the start; the distance rule then gives
+// the distance from a node to the start, as it needs to.  Predecessors of
+// nodes are found with the reverse neighbors rule, or with the neighbors
+// rule if there is none, in which case the graph is taken to be symmetric.
+// The neighbors rule must return its neighbors directly; persistent
+// searches can't wait on Astar_Result_Processing.  The completion rule and
+// the cache are not used.
+
+#include <astar.h>
+
+inherit "/mod/algorithm/astar";
+
+// The cost standing for there being no path
+#define Replan_Infinity                         __FLOAT_MAX__
+
+// Fields of the neighbor lists used internally
+#define Replan_Neighbor_Node                    0
+#define Replan_Neighbor_Key                     1
+#define Replan_Neighbor_Cost                    2
+#define Replan_Neighbor_Edge                    3
+
+// SECTION: Internal support functions
+
+// replan_key()
+//
+// Node key retrieval, as done by the A* module.
+
+private mixed replan_key(mixed node) {
+	return astar_node_key(node);
+}
+
+// replan_cost()
+//
+// Returns the cost of the best path found from a node to the goal.
+
+private float replan_cost(mixed * search, mixed key) {
+	mapping costs = search[Astar_Replan_Costs];
+	return member(costs, key) ? costs[key] : Replan_Infinity;
+}
+
+// replan_lookahead()
+//
+// Returns the one-step lookahead cost from a node to the goal.
+
+private float replan_lookahead(mixed * search, mixed key) {
+	mapping lookahead = search[Astar_Replan_Lookahead];
+	return member(lookahead, key) ? lookahead[key] : Replan_Infinity;
+}
+
+// replan_heuristic()
+//
+// Returns the distance rule's estimate of the cost from a node to 'to',
+// or 0.0 if it has none.
+
+private float replan_heuristic(mixed * search, mixed node, mixed to) {
+	closure rule = query_astar_distance_rule();
+	if(!rule)
+		return 0.0;
+	mixed * pathfind = search[Astar_Replan_Pathfind];
+	mixed start = pathfind[Astar_Pathfind_To];
+	pathfind[Astar_Pathfind_Active_Node] = node;
+	pathfind[Astar_Pathfind_To] = to;
+	mixed out = funcall(rule, pathfind);
+	pathfind[Astar_Pathfind_To] = start;
+	return out == -1 ? 0.0 : to_float(out);
+}
+
+// replan_neighbors()
+//
+// Retrieves the successors of a node, or its predecessors if 'reverse' is
+// true, as ({ node, node key, cost, edge }) arrays, with the costs set by
+// astar_update_edge() applied and the nodes rejected by 'validate' left
+// out.  The edge given is always the edge in the forward direction.
+
+private mixed * replan_neighbors(mixed * search, mixed node, int reverse) {
+	mixed * pathfind = search[Astar_Replan_Pathfind];
+	pathfind[Astar_Pathfind_Active_Node] = node;
+	pathfind[Astar_Pathfind_Active_Edge] = 0;
+	closure rule = (reverse && query_astar_reverse_neighbors_rule()) || query_astar_neighbors_rule();
+	mixed list;
+	if(rule) {
+		list = funcall(rule, pathfind);
+	} else {
+		pathfind[Astar_Pathfind_Active_Nodes] = ({ node });
+		pathfind[Astar_Pathfind_Active_Edges] = ({ 0 });
+		list = funcall(query_astar_batch_neighbors_rule(), pathfind);
+		pathfind[Astar_Pathfind_Active_Nodes] = 0;
+		pathfind[Astar_Pathfind_Active_Edges] = 0;
+		list = pointerp(list) && sizeof(list) == 1 && list[0];
+	}
+	if(!pointerp(list))
+		raise_error("Invalid return value from neighbors rule for persistent search");
+	mixed key = replan_key(node);
+	mapping nodes = search[Astar_Replan_Nodes];
+	mapping overrides = search[Astar_Replan_Cost_Overrides];
+	closure validate = pathfind[Astar_Pathfind_Validate];
+	mixed * out = ({});
+	foreach(mixed * neighbor : list) {
+		mixed other = neighbor[0];
+		mixed other_key = replan_key(other);
+		nodes[other_key] = other;
+		mixed cost = neighbor[2];
+		mapping from_overrides = overrides[reverse ? other_key : key];
+		mixed to_key = reverse ? key : other_key;
+		if(from_overrides && member(from_overrides, to_key))
+			cost = from_overrides[to_key];
+		if(cost == Astar_Replan_Cost_Blocked)
+			continue;
+		if(validate) {
+			pathfind[Astar_Pathfind_Active_Node] = reverse ? node : other;
+			pathfind[Astar_Pathfind_Active_Edge] = neighbor[1];
+			if(!funcall(validate, pathfind))
+				continue;
+		}
+		out += ({ ({ other, other_key, to_float(cost), neighbor[1] }) });
+	}
+	return out;
+}
+
+// replan_key_precedes()
+//
+// Ordering test for queue priorities, which are compared on their first
+// element, then their second.
+
+private int replan_key_precedes(mixed * a, mixed * b) {
+	return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+}
+
+// replan_priority()
+//
+// Calculates the queue priority of a node.
+
+private float * replan_priority(mixed * search, mixed key) {
+	float cost = replan_cost(search, key);
+	float lookahead = replan_lookahead(search, key);
+	float best = cost < lookahead ? cost : lookahead;
+	if(best >= Replan_Infinity)
+		return ({ Replan_Infinity, Replan_Infinity });
+	float estimate = replan_heuristic(search, search[Astar_Replan_Nodes][key], search[Astar_Replan_Start]);
+	return ({ best + estimate + search[Astar_Replan_Key_Modifier], best });
+}
+
+// replan_queue_insert()
+//
+// Queues a node with the given priority, superseding any entry it already
+// has in the queue.
+
+private void replan_queue_insert(mixed * search, mixed key, float * priority) {
+	mixed * entry = ({ priority[0], priority[1], key });
+	search[Astar_Replan_Queued][key] = entry;
+	mixed * heap = search[Astar_Replan_Queue];
+	int ix = search[Astar_Replan_Queue_Count]++;
+	if(ix >= sizeof(heap)) {
+		heap += allocate(sizeof(heap) || 1);
+		search[Astar_Replan_Queue] = heap;
+	}
+	while(ix > 0) {
+		int parent = (ix - 1) >> 1;
+		if(!replan_key_precedes(entry, heap[parent]))
+			break;
+		heap[ix] = heap[parent];
+		ix = parent;
+	}
+	heap[ix] = entry;
+}
+
+// replan_queue_pop()
+//
+// Removes the entry at the top of the queue heap.
+
+private void replan_queue_pop(mixed * search) {
+	mixed * heap = search[Astar_Replan_Queue];
+	int count = --search[Astar_Replan_Queue_Count];
+	mixed * last = heap[count];
+	heap[count] = 0;
+	if(!count)
+		return;
+	int ix = 0;
+	for(;;) {
+		int child = (ix << 1) + 1;
+		if(child >= count)
+			break;
+		if(child + 1 < count && replan_key_precedes(heap[child + 1], heap[child]))
+			child++;
+		if(!replan_key_precedes(heap[child], last))
+			break;
+		heap[ix] = heap[child];
+		ix = child;
+	}
+	heap[ix] = last;
+}
+
+// replan_queue_top()
+//
+// Returns the current entry with the best priority in the queue, or 0 if
+// it is empty, discarding stale entries from the top of the heap.
+
+private mixed * replan_queue_top(mixed * search) {
+	mapping queued = search[Astar_Replan_Queued];
+	while(search[Astar_Replan_Queue_Count]) {
+		mixed * entry = search[Astar_Replan_Queue][0];
+		if(queued[entry[2]] == entry)
+			return entry;
+		replan_queue_pop(search);
+	}
+	return 0;
+}
+
+// replan_update_node()
+//
+// Brings a node's lookahead cost up to date with the costs of its
+// successors, and queues it if that leaves it inconsistent with its cost.
+
+private void replan_update_node(mixed * search, mixed key) {
+	mixed node = search[Astar_Replan_Nodes][key];
+	if(key != replan_key(search[Astar_Replan_Goal])) {
+		float best = Replan_Infinity;
+		foreach(mixed * neighbor : replan_neighbors(search, node, 0)) {
+			float cost = replan_cost(search, neighbor[Replan_Neighbor_Key]);
+			if(cost < Replan_Infinity && neighbor[Replan_Neighbor_Cost] + cost < best)
+				best = neighbor[Replan_Neighbor_Cost] + cost;
+		}
+		if(best < Replan_Infinity)
+			search[Astar_Replan_Lookahead][key] = best;
+		else
+			map_delete(search[Astar_Replan_Lookahead], key);
+	}
+	map_delete(search[Astar_Replan_Queued], key);
+	if(replan_cost(search, key) != replan_lookahead(search, key))
+		replan_queue_insert(search, key, replan_priority(search, key));
+}
+
+// replan_compute()
+//
+// Settles node costs until the start node's cost is known to be right.
+// Returns true when done, or false if the run limit was reached first.
+
+private int replan_compute(mixed * search) {
+	mixed * pathfind = search[Astar_Replan_Pathfind];
+	mixed start_key = replan_key(search[Astar_Replan_Start]);
+	astar_cycle_begin(pathfind);
+	for(;;) {
+		mixed * top = replan_queue_top(search);
+		if(!top)
+			return 1;
+		if(!replan_key_precedes(top, replan_priority(search, start_key)) && replan_cost(search, start_key) == replan_lookahead(search, start_key))
+			return 1;
+		pathfind[Astar_Pathfind_Cycle_Iterations]++;
+		if(astar_run_limit_reached(pathfind))
+			return 0;
+		mixed key = top[2];
+		replan_queue_pop(search);
+		map_delete(search[Astar_Replan_Queued], key);
+		float * priority = replan_priority(search, key);
+		mixed node = search[Astar_Replan_Nodes][key];
+		if(replan_key_precedes(top, priority)) {
+			// The node's priority has gone up since it was queued; queue it again where it belongs.
+			replan_queue_insert(search, key, priority);
+		} else if(replan_cost(search, key) > replan_lookahead(search, key)) {
+			// The node has a cheaper way to the goal than it had; settle it and pass the news along.
+			search[Astar_Replan_Costs][key] = replan_lookahead(search, key);
+			search[Astar_Replan_Stats_Expanded]++;
+			foreach(mixed * neighbor : replan_neighbors(search, node, 1))
+				replan_update_node(search, neighbor[Replan_Neighbor_Key]);
+		} else {
+			// The node's way to the goal has gotten more expensive; unsettle it and everything that relied on it.
+			map_delete(search[Astar_Replan_Costs], key);
+			search[Astar_Replan_Stats_Expanded]++;
+			foreach(mixed * neighbor : replan_neighbors(search, node, 1))
+				replan_update_node(search, neighbor[Replan_Neighbor_Key]);
+			replan_update_node(search, key);
+		}
+	}
+}
+
+// replan_path()
+//
+// Assembles the path from the start node to the goal by following, from
+// each node, the successor with the cheapest way to the goal.  Returns
+// Astar_Result_Impossible if there is no path.
+
+private mixed replan_path(mixed * search) {
+	mixed key = replan_key(search[Astar_Replan_Start]);
+	mixed goal_key = replan_key(search[Astar_Replan_Goal]);
+	if(replan_cost(search, key) >= Replan_Infinity)
+		return Astar_Result_Impossible;
+	mixed * nodes = ({ search[Astar_Replan_Start] });
+	mixed * edges = ({});
+	float total = 0.0;
+	mapping seen = ([ key : 1 ]);
+	while(key != goal_key) {
+		mixed * best = 0;
+		float best_cost = Replan_Infinity;
+		foreach(mixed * neighbor : replan_neighbors(search, nodes[<1], 0)) {
+			float cost = replan_cost(search, neighbor[Replan_Neighbor_Key]);
+			if(cost < Replan_Infinity && neighbor[Replan_Neighbor_Cost] + cost < best_cost) {
+				best = neighbor;
+				best_cost = neighbor[Replan_Neighbor_Cost] + cost;
+			}
+		}
+		if(!best || member(seen, best[Replan_Neighbor_Key]))
+			return Astar_Result_Impossible;
+		key = best[Replan_Neighbor_Key];
+		seen[key] = 1;
+		nodes += ({ best[Replan_Neighbor_Node] });
+		edges += ({ best[Replan_Neighbor_Edge] });
+		total += best[Replan_Neighbor_Cost];
+	}
+	mixed * path = allocate(Astar_Path_Fields);
+	path[Astar_Path_Nodes] = nodes;
+	path[Astar_Path_Edges] = edges;
+	path[Astar_Path_Distance] = 0.0;
+	path[Astar_Path_Cost] = total;
+	return path;
+}
+
+// replan_run()
+//
+// Performs the work of a replan; takes a replan data structure as
+// argument, and can resume from any point in the replan, continuing via
+// the scheduling rule if there is a callback and the run limit is reached.
+
+private void replan_run(mixed * search) {
+	if(!replan_compute(search)) {
+		if(search[Astar_Replan_Callback]) {
+			search[Astar_Replan_Result] = Astar_Result_Processing;
+			funcall(query_astar_scheduling_rule() || #'call_out, #'replan_run, 2, search);
+		} else {
+			search[Astar_Replan_Result] = Astar_Result_Cut_Off;
+		}
+		return;
+	}
+	search[Astar_Replan_Result] = replan_path(search);
+	if(search[Astar_Replan_Callback])
+		funcall(search[Astar_Replan_Callback], search);
+}
+
+// SECTION: Operational interface
+
+// astar_open_search()
+//
+// Sets up a persistent search for paths from 'from' to 'to', returning the
+// replan data structure (see the Astar_Replan_* macros in astar.h) that
+// stands for it.  'validate', 'callback' and 'extra' are as for
+// astar_find_path(); the callback is called with the replan data structure
+// at the end of each replan, and its presence lets replans continue via
+// the scheduling rule when the run limit is reached.  No searching is done
+// until astar_replan() is called.
+
+varargs mixed * astar_open_search(mixed from, mixed to, closure validate, closure callback, mixed extra) {
+	mixed * search = allocate(Astar_Replan_Fields);
+	mixed * pathfind = astar_pathfind_create(to, from, validate, 0, Astar_Pathfind_Control_Flag_Uncache | Astar_Pathfind_Control_Flag_No_Continue, extra);
+	// Take our nodes back from the pathfind, as the node rule has had its way with them
+	from = pathfind[Astar_Pathfind_To];
+	to = pathfind[Astar_Pathfind_From];
+	search[Astar_Replan_Pathfind] = pathfind;
+	search[Astar_Replan_Start] = from;
+	search[Astar_Replan_Goal] = to;
+	search[Astar_Replan_Last_Start] = from;
+	search[Astar_Replan_Key_Modifier] = 0.0;
+	search[Astar_Replan_Costs] = ([]);
+	search[Astar_Replan_Lookahead] = ([]);
+	search[Astar_Replan_Nodes] = ([]);
+	search[Astar_Replan_Queue] = ({});
+	search[Astar_Replan_Queue_Count] = 0;
+	search[Astar_Replan_Queued] = ([]);
+	search[Astar_Replan_Cost_Overrides] = ([]);
+	search[Astar_Replan_Callback] = callback;
+	mixed goal_key = replan_key(to);
+	search[Astar_Replan_Nodes][replan_key(from)] = from;
+	search[Astar_Replan_Nodes][goal_key] = to;
+	search[Astar_Replan_Lookahead][goal_key] = 0.0;
+	replan_queue_insert(search, goal_key, replan_priority(search, goal_key));
+	return search;
+}
+
+// astar_replan()
+//
+// Brings a persistent search up to date with the moves and changes made
+// since it was last replanned, and returns the path from the start node to
+// the goal, or an Astar_Result_* code as astar_find_path() would give in
+// pathfind[Astar_Pathfind_Result].  The result is also kept in
+// search[Astar_Replan_Result].
+
+mixed astar_replan(mixed * search) {
+	replan_run(search);
+	return search[Astar_Replan_Result];
+}
+
+// astar_move_start()
+//
+// Moves the start of a persistent search to 'node', as when the agent has
+// moved.  The costs already found remain good, since they are costs to the
+// goal.
+
+void astar_move_start(mixed * search, mixed node) {
+	closure node_rule = query_astar_node_rule();
+	if(node_rule)
+		node = funcall(node_rule, node);
+	search[Astar_Replan_Key_Modifier] += replan_heuristic(search, search[Astar_Replan_Last_Start], node);
+	search[Astar_Replan_Last_Start] = node;
+	search[Astar_Replan_Start] = node;
+	search[Astar_Replan_Nodes][replan_key(node)] = node;
+	search[Astar_Replan_Pathfind][Astar_Pathfind_To] = node;
+}
+
+// astar_update_edge()
+//
+// Changes the cost of the edge from 'from' to 'to' in a persistent search
+// to 'cost', which may be Astar_Replan_Cost_Blocked to make the edge
+// impassable or Astar_Replan_Cost_Rule to go back to using the cost the
+// neighbors rule gives.  Only edges the neighbors rule returns can be
+// changed this way; if the neighbors rule itself now gives different
+// results for a node, use astar_update_node().
+
+void astar_update_edge(mixed * search, mixed from, mixed to, mixed cost) {
+	closure node_rule = query_astar_node_rule();
+	if(node_rule) {
+		from = funcall(node_rule, from);
+		to = funcall(node_rule, to);
+	}
+	mixed from_key = replan_key(from);
+	mixed to_key = replan_key(to);
+	mapping overrides = search[Astar_Replan_Cost_Overrides];
+	if(cost == Astar_Replan_Cost_Rule) {
+		if(overrides[from_key]) {
+			map_delete(overrides[from_key], to_key);
+			if(!sizeof(overrides[from_key]))
+				map_delete(overrides, from_key);
+		}
+	} else {
+		overrides[from_key] ||= ([]);
+		overrides[from_key][to_key] = cost;
+	}
+	search[Astar_Replan_Nodes][from_key] = from;
+	replan_update_node(search, from_key);
+}
+
+// astar_update_node()
+//
+// Tells a persistent search that the neighbors rule's results for 'node'
+// have changed, as when an exit has been added to or removed from it.  If
+// edges leading into the node have changed, call this for the nodes they
+// lead from.
+
+void astar_update_node(mixed * search, mixed node) {
+	closure node_rule = query_astar_node_rule();
+	if(node_rule)
+		node = funcall(node_rule, node);
+	mixed key = replan_key(node);
+	search[Astar_Replan_Nodes][key] = node;
+	replan_update_node(search, key);
+}
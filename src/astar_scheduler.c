@@ -0,0 +1,148 @@
+// A* Search Scheduler Daemon
+//
+// Continues the pathfinds of every object using the A* search module with
+// central scheduling turned on, from a single queue, so that when many
+// pathfinds are under way at once they share the time given to them in a
+// fair and predictable way rather than each being continued by its own
+// call_out().  Each heartbeat, the daemon spends a fixed budget of eval
+// ticks continuing pathfinds, taking them highest priority first, then
+// earliest deadline, then in the order they were queued; a pathfind that
+// reaches its run limit again goes to the back of those of equal standing,
+// so they take turns.
+//
+// Usage: place this file where Astar_Scheduler_Daemon in astar.h points,
+// /mod/algorithm/astar_scheduler by default, and have the objects using the
+// A* module call set_astar_central_scheduling(1).  The budget can be
+// changed with set_astar_scheduler_budget().  Each pathfind's own run limit
+// still decides how much it does per processing cycle, so a run limit much
+// smaller than the budget is what lets the daemon share the budget out.
+
+#include <astar.h>
+
+// The queue: a binary heap of Astar_Scheduled_* structures, of which the
+// first queue_count positions are in use.
+
+private mixed * queue = ({});
+private int queue_count;
+private int queue_sequence;
+private int budget = Astar_Scheduler_Default_Budget;
+
+// SECTION: Configuration
+
+// Budget
+//
+// The number of eval ticks spent continuing pathfinds each heartbeat.  The
+// daemon stops starting new processing cycles once it has spent this many,
+// so the cycle in progress can take it somewhat over.
+
+void set_astar_scheduler_budget(int val) {
+	budget = val;
+}
+
+int query_astar_scheduler_budget() {
+	return budget;
+}
+
+// SECTION: Internal support functions
+
+// scheduler_precedes()
+//
+// Ordering test for the queue; true if continuation 'a' should be run
+// before 'b'.
+
+private int scheduler_precedes(mixed * a, mixed * b) {
+	if(a[Astar_Scheduled_Priority] != b[Astar_Scheduled_Priority])
+		return a[Astar_Scheduled_Priority] > b[Astar_Scheduled_Priority];
+	if(a[Astar_Scheduled_Deadline] != b[Astar_Scheduled_Deadline]) {
+		if(!b[Astar_Scheduled_Deadline])
+			return 1;
+		if(!a[Astar_Scheduled_Deadline])
+			return 0;
+		return a[Astar_Scheduled_Deadline] < b[Astar_Scheduled_Deadline];
+	}
+	return a[Astar_Scheduled_Sequence] < b[Astar_Scheduled_Sequence];
+}
+
+// scheduler_pop()
+//
+// Removes and returns the continuation at the top of the queue.
+
+private mixed * scheduler_pop() {
+	mixed * top = queue[0];
+	mixed * last = queue[--queue_count];
+	queue[queue_count] = 0;
+	if(queue_count) {
+		int ix = 0;
+		for(;;) {
+			int child = (ix << 1) + 1;
+			if(child >= queue_count)
+				break;
+			if(child + 1 < queue_count && scheduler_precedes(queue[child + 1], queue[child]))
+				child++;
+			if(!scheduler_precedes(queue[child], last))
+				break;
+			queue[ix] = queue[child];
+			ix = child;
+		}
+		queue[ix] = last;
+	}
+	return top;
+}
+
+// SECTION: Operational interface
+
+// astar_scheduler_enqueue()
+//
+// Called by the A* module, in the object doing the pathfind, to have the
+// pathfind continued; 'function' is called with 'pathfind' as argument when
+// its turn comes.
+
+void astar_scheduler_enqueue(closure function, mixed * pathfind) {
+	mixed * entry = allocate(Astar_Scheduled_Fields);
+	entry[Astar_Scheduled_Priority] = pathfind[Astar_Pathfind_Priority];
+	entry[Astar_Scheduled_Deadline] = pathfind[Astar_Pathfind_Deadline];
+	entry[Astar_Scheduled_Sequence] = ++queue_sequence;
+	entry[Astar_Scheduled_Function] = function;
+	entry[Astar_Scheduled_Pathfind] = pathfind;
+	if(queue_count >= sizeof(queue))
+		queue += allocate(sizeof(queue) || 1);
+	int ix = queue_count++;
+	while(ix > 0) {
+		int parent = (ix - 1) >> 1;
+		if(!scheduler_precedes(entry, queue[parent]))
+			break;
+		queue[ix] = queue[parent];
+		ix = parent;
+	}
+	queue[ix] = entry;
+	set_heart_beat(1);
+}
+
+// heart_beat()
+//
+// Continues queued pathfinds until the budget is spent or the queue is
+// empty.  An error in one pathfind does not hold up the others.
+
+void heart_beat() {
+	int start = get_eval_cost();
+	while(queue_count && start - get_eval_cost() < budget) {
+		mixed * entry = scheduler_pop();
+		closure function = entry[Astar_Scheduled_Function];
+		// The object that queued the pathfind may have gone away since.
+		if(!to_object(function))
+			continue;
+		catch(funcall(function, entry[Astar_Scheduled_Pathfind]));
+	}
+	if(!queue_count)
+		set_heart_beat(0);
+}
+
+// query_astar_scheduler_queue()
+//
+// Returns the pathfind data structures waiting to be continued, in the
+// order they will be.
+
+mixed * query_astar_scheduler_queue() {
+	mixed * entries = sort_array(queue[0 .. queue_count - 1], (: !scheduler_precedes($1, $2) :));
+	return map(entries, (: $1[Astar_Scheduled_Pathfind] :));
+}